@@ -0,0 +1,283 @@
+/******************************************************
+ *
+ *  A maximum path fold that keeps its accumulator in
+ *  the narrowest integers that can hold it.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "adaptive.h"
+#include "dispatch.h"
+
+#include <algorithm>      // std::max, std::minmax_element
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EULER67_ADAPTIVE_AVX2 1
+#endif
+
+
+namespace {
+
+#ifdef EULER67_ADAPTIVE_AVX2
+
+/* Fold sixteen values at a time into an int16 accumulator and return how
+ * many were folded. The values are narrowed to 16 bits with saturation, so
+ * any value outside the int16 range sets `overflow` too, as does any sum
+ * that overflows (its sign differs from the signs of both inputs).
+ */
+__attribute__((target("avx2")))
+size_t simd_fold_row(std::int16_t* accum, int const* values, size_t size,
+                     bool& overflow)
+{
+    __m256i const high = _mm256_set1_epi32(std::numeric_limits<std::int16_t>::max());
+    __m256i const low = _mm256_set1_epi32(std::numeric_limits<std::int16_t>::min());
+    __m256i flags = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m256i const v0 = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(values + i));
+        __m256i const v1 = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(values + i + 8));
+
+        flags = _mm256_or_si256(flags, _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(v0, high), _mm256_cmpgt_epi32(low, v0)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(v1, high), _mm256_cmpgt_epi32(low, v1))));
+
+        // packs works within each 128-bit half, so put the halves back in
+        // order afterwards.
+        __m256i const value = _mm256_permute4x64_epi64(
+            _mm256_packs_epi32(v0, v1), 0xD8);
+
+        __m256i const left = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i + 1));
+        __m256i const best = _mm256_max_epi16(left, right);
+        __m256i const sum = _mm256_add_epi16(value, best);
+
+        flags = _mm256_or_si256(flags, _mm256_and_si256(
+            _mm256_xor_si256(value, sum), _mm256_xor_si256(best, sum)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i), sum);
+    }
+
+    if (_mm256_movemask_epi8(_mm256_srai_epi16(flags, 15)) != 0)
+        overflow = true;
+    return i;
+}
+
+/* The same for an int32 accumulator, eight values at a time. Every int
+ * fits, so only the sums are checked.
+ */
+__attribute__((target("avx2")))
+size_t simd_fold_row(std::int32_t* accum, int const* values, size_t size,
+                     bool& overflow)
+{
+    __m256i flags = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const value = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(values + i));
+        __m256i const left = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i + 1));
+        __m256i const best = _mm256_max_epi32(left, right);
+        __m256i const sum = _mm256_add_epi32(value, best);
+
+        flags = _mm256_or_si256(flags, _mm256_and_si256(
+            _mm256_xor_si256(value, sum), _mm256_xor_si256(best, sum)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i), sum);
+    }
+
+    if (_mm256_movemask_ps(_mm256_castsi256_ps(flags)) != 0)
+        overflow = true;
+    return i;
+}
+
+#endif // EULER67_ADAPTIVE_AVX2
+
+// The int64 accumulator is folded with plain scalar code.
+size_t simd_fold_row(std::int64_t*, int const*, size_t, bool&)
+{
+    return 0;
+}
+
+
+/* Fold the rows [lo, hi) into `accum`, from the bottom up. Returns false
+ * if any result did not fit in Acc, in which case `accum` holds garbage.
+ */
+template <typename Acc>
+bool fold_block(std::vector<Acc>& accum, Triangle const& triangle,
+                size_t lo, size_t hi)
+{
+    long long const lowest = std::numeric_limits<Acc>::min();
+    long long const highest = std::numeric_limits<Acc>::max();
+
+#ifdef EULER67_ADAPTIVE_AVX2
+    bool const simd = isa_level() >= IsaLevel::Avx2;
+#endif
+
+    bool overflow = false;
+    for (size_t r = hi; r-- != lo; )
+    {
+        int const* values = triangle.row(r).data();
+        size_t const size = r + 1;
+
+        size_t i = 0;
+#ifdef EULER67_ADAPTIVE_AVX2
+        if (simd)
+            i = simd_fold_row(accum.data(), values, size, overflow);
+#endif
+        for (; i != size; ++i)
+        {
+            long long const sum = values[i] + static_cast<long long>(
+                std::max(accum[i], accum[i + 1]));
+            overflow = overflow || sum < lowest || sum > highest;
+            accum[i] = static_cast<Acc>(sum);
+        }
+
+        // Once a block has overflowed it will be folded again anyway.
+        if (overflow)
+            return false;
+    }
+    return true;
+}
+
+template <typename To, typename From>
+void widen(std::vector<From> const& from, size_t size, std::vector<To>& to)
+{
+    to.assign(from.begin(), from.begin() + size);
+}
+
+/* The smallest and largest live results, used to judge the headroom.
+ */
+template <typename Values>
+void live_range(Values const& accum, size_t size,
+                long long& smallest, long long& largest)
+{
+    auto const bounds = std::minmax_element(accum.begin(), accum.begin() + size);
+    smallest = *bounds.first;
+    largest = *bounds.second;
+}
+
+/* Whether a block that moves the results as far as the last one did would
+ * leave the range of Acc.
+ */
+template <typename Acc>
+bool short_of_headroom(long long smallest, long long largest,
+                       long long previous_smallest, long long previous_largest)
+{
+    long long const rise = std::max(0ll, largest - previous_largest);
+    long long const fall = std::max(0ll, previous_smallest - smallest);
+
+    return largest + rise > std::numeric_limits<Acc>::max()
+        || smallest - fall < std::numeric_limits<Acc>::min();
+}
+
+} // namespace
+
+
+AdaptiveResult max_path_adaptive(Triangle const& triangle, size_t block_rows)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "max_path_adaptive expects a non-empty triangle");
+    }
+    block_rows = std::max<size_t>(block_rows, 1);
+
+    std::vector<std::int16_t> accum16, backup16;
+    std::vector<std::int32_t> accum32, backup32;
+    std::vector<std::int64_t> accum64;
+
+    // Start from the bottom row, in 16 bits if it fits.
+    RowView const leaves = triangle.rows().back();
+    long long smallest, largest;
+    live_range(leaves, leaves.size(), smallest, largest);
+
+    Precision precision = Precision::Int32;
+    if (smallest >= std::numeric_limits<std::int16_t>::min()
+        && largest <= std::numeric_limits<std::int16_t>::max())
+    {
+        precision = Precision::Int16;
+        accum16.assign(leaves.begin(), leaves.end());
+    }
+    else
+    {
+        accum32.assign(leaves.begin(), leaves.end());
+    }
+
+    // The rows [lo, hi) are the next block; `hi + 1` results are live.
+    size_t hi = triangle.height() - 1;
+    while (hi != 0)
+    {
+        size_t const lo = hi > block_rows ? hi - block_rows : 0;
+        long long const previous_smallest = smallest;
+        long long const previous_largest = largest;
+
+        if (precision == Precision::Int16)
+        {
+            backup16.assign(accum16.begin(), accum16.begin() + hi + 1);
+            if (!fold_block(accum16, triangle, lo, hi))
+            {
+                widen(backup16, hi + 1, accum32);
+                precision = Precision::Int32;
+                continue;
+            }
+
+            live_range(accum16, lo + 1, smallest, largest);
+            if (short_of_headroom<std::int16_t>(smallest, largest,
+                    previous_smallest, previous_largest))
+            {
+                widen(accum16, lo + 1, accum32);
+                precision = Precision::Int32;
+            }
+        }
+        else if (precision == Precision::Int32)
+        {
+            backup32.assign(accum32.begin(), accum32.begin() + hi + 1);
+            if (!fold_block(accum32, triangle, lo, hi))
+            {
+                widen(backup32, hi + 1, accum64);
+                precision = Precision::Int64;
+                continue;
+            }
+
+            live_range(accum32, lo + 1, smallest, largest);
+            if (short_of_headroom<std::int32_t>(smallest, largest,
+                    previous_smallest, previous_largest))
+            {
+                widen(accum32, lo + 1, accum64);
+                precision = Precision::Int64;
+            }
+        }
+        else
+        {
+            fold_block(accum64, triangle, lo, hi);
+        }
+
+        hi = lo;
+    }
+
+    AdaptiveResult result;
+    result.precision = precision;
+    switch (precision)
+    {
+    case Precision::Int16: result.max_path = accum16.front(); break;
+    case Precision::Int32: result.max_path = accum32.front(); break;
+    case Precision::Int64: result.max_path = accum64.front(); break;
+    }
+    return result;
+}
@@ -0,0 +1,56 @@
+/******************************************************
+ *
+ *  A maximum path fold that keeps its accumulator in
+ *  the narrowest integers that can hold it.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_ADAPTIVE_H
+#define EULER67_ADAPTIVE_H
+
+#include "triangle.h"
+
+
+/* The precision of the accumulator of `max_path_adaptive`.
+ */
+enum class Precision {
+    Int16,
+    Int32,
+    Int64,
+};
+
+struct AdaptiveResult {
+    long long max_path;
+    Precision precision;      // the widest precision the fold needed
+};
+
+/* Computes the same result as `max_path`, exactly, however large it is.
+ *
+ * Most triangles have path sums that fit in 16 bits, and a SIMD register
+ * holds twice as many 16-bit lanes as 32-bit ones. So the fold starts with
+ * an int16 accumulator and works through the triangle in blocks of
+ * `block_rows` rows:
+ *
+ *   - Every addition of a block is checked for overflow (an OR-reduced
+ *     flag, as in overflow.h), and so is every value of the triangle that
+ *     does not fit in the current precision. If the flag is set, the block
+ *     is undone from a copy of the accumulator taken at its start, the
+ *     accumulator is widened, and the block is folded again.
+ *
+ *   - After each block, the largest and smallest results in the
+ *     accumulator are compared with the headroom left in the current
+ *     precision. If another block of values as large as the last one
+ *     could overflow, the accumulator is widened before it starts, so
+ *     that a block rarely has to be undone.
+ *
+ * The accumulator is widened from int16 to int32 and then int64, and never
+ * narrowed again. Uses AVX2 for the int16 and int32 blocks where the CPU
+ * has it.
+ */
+AdaptiveResult max_path_adaptive(Triangle const& triangle,
+                                 size_t block_rows = 64);
+
+#endif // EULER67_ADAPTIVE_H
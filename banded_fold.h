@@ -0,0 +1,196 @@
+/******************************************************
+ *
+ *  The bottom-up fold split into horizontal bands of
+ *  rows, each folded by a different worker.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_BANDED_FOLD_H
+#define EULER67_BANDED_FOLD_H
+
+#include "triangle.h"
+#include "transport.h"
+
+#include <cstring>        // std::memcpy
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+/* The rows `first` up to (but not including) `end` of a triangle.
+ */
+struct RowBand {
+    size_t first;
+    size_t end;
+};
+
+/* Split the rows of a triangle of height `height` into at most `bands`
+ * bands, from the top down. Rows get longer further down, so the bands are
+ * chosen to hold about the same number of values rather than rows.
+ */
+inline std::vector<RowBand> partition_rows(size_t height, unsigned bands)
+{
+    if (bands == 0)
+        throw std::invalid_argument("partition_rows needs at least one band");
+
+    double const cells = double(height) * double(height + 1) / 2;
+
+    std::vector<RowBand> result;
+    size_t first = 0;
+    for (unsigned b = 1; b <= bands && first != height; ++b)
+    {
+        // The rows above row `end` hold end * (end + 1) / 2 values.
+        size_t end = first + 1;
+        while (end < height && double(end) * double(end + 1) / 2 < cells * b / bands)
+            ++end;
+        if (b == bands)
+            end = height;
+
+        result.push_back(RowBand { first, end });
+        first = end;
+    }
+    return result;
+}
+
+
+/* fold_band<T>(transport, triangle, bands, make_t, combine_t)
+ *     - one worker's share of `fold_triangle<T>`: worker `rank` folds the
+ *       rows of `bands[rank]`, so worker 0 holds the top band and the last
+ *       worker holds the bottom band
+ *     - returns the result of the whole fold on worker 0; on every other
+ *       worker the return value is meaningless
+ *
+ * The bottom worker starts the fold with `make_t` as usual. Every other
+ * worker waits for the accumulator of the band below it, which is the only
+ * thing a band depends on, folds its own rows into it and passes the result
+ * up. Each message is therefore a single accumulator row, O(width) in size,
+ * and a worker only ever reads the rows of its own band, so on a real
+ * network each worker need only hold its band of the triangle.
+ *
+ * Accumulators are sent as raw bytes, so T must be trivially copyable, and
+ * every worker must have the same representation of T. If a worker fails,
+ * it sends an empty message up instead, so that the workers above it fail
+ * too rather than waiting forever.
+ */
+template <typename T>
+T fold_band(Transport& transport, Triangle const& triangle,
+       std::vector<RowBand> const& bands,
+       std::function<T(int)> const& make_t,
+       std::function<T(int,T,T)> const& combine_t)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "fold_band sends accumulators as raw bytes");
+
+    unsigned const rank = transport.rank();
+    bool const bottom = rank + 1 == bands.size();
+    RowBand const band = bands.at(rank);
+
+    std::vector<T> accum;
+    try {
+        if (bottom)
+        {
+            if (triangle.height() == 0 || band.end != triangle.height()) {
+                throw std::invalid_argument(
+                    "fold_band expects the bands to cover a non-empty triangle");
+            }
+
+            accum.reserve(band.end);
+            for (int value: triangle.row(band.end - 1))
+                accum.emplace_back(make_t(value));
+        }
+        else
+        {
+            Message const below = transport.receive(rank + 1);
+            if (below.empty())
+                throw std::runtime_error("fold_band: the band below failed");
+            if (below.size() != (band.end + 1) * sizeof(T))
+                throw std::runtime_error("fold_band: malformed accumulator");
+
+            accum.resize(band.end + 1);
+            std::memcpy(accum.data(), below.data(), below.size());
+        }
+
+        // The bottom row of the bottom band was consumed by `make_t`.
+        size_t const top_of_fold = bottom ? band.end - 1 : band.end;
+        for (size_t r = top_of_fold; r-- != band.first; )
+        {
+            RowView const row = triangle.row(r);
+            fold_row<T>(accum, row.data(), row.size(), combine_t);
+        }
+    }
+    catch (...) {
+        if (rank != 0)
+            transport.send(rank - 1, Message());
+        throw;
+    }
+
+    if (rank == 0)
+        return accum.front();
+
+    // Only the values under the next band up are still needed.
+    Message above((band.first + 1) * sizeof(T));
+    std::memcpy(above.data(), accum.data(), above.size());
+    transport.send(rank - 1, std::move(above));
+    return T();
+}
+
+/* fold_triangle_banded<T>(triangle, bands, make_t, combine_t)
+ *     - computes the same result as `fold_triangle<T>` by running
+ *       `fold_band` on one thread per band, connected by a LoopbackNetwork
+ */
+template <typename T>
+T fold_triangle_banded(Triangle const& triangle, unsigned bands,
+       std::function<T(int)> const& make_t,
+       std::function<T(int,T,T)> const& combine_t)
+{
+    std::vector<RowBand> const partition = partition_rows(triangle.height(), bands);
+    if (partition.empty()) {
+        throw std::invalid_argument(
+            "fold_triangle_banded expects a non-empty triangle");
+    }
+
+    LoopbackNetwork network {static_cast<unsigned>(partition.size())};
+
+    std::vector<std::exception_ptr> errors(partition.size());
+    std::vector<std::thread> workers;
+    for (unsigned rank = 1; rank != partition.size(); ++rank)
+    {
+        workers.emplace_back([&, rank] {
+            try {
+                fold_band<T>(network.endpoint(rank), triangle, partition,
+                             make_t, combine_t);
+            }
+            catch (...) {
+                errors[rank] = std::current_exception();
+            }
+        });
+    }
+
+    // This thread is worker 0, which folds the top band.
+    T result = T();
+    try {
+        result = fold_band<T>(network.endpoint(0), triangle, partition,
+                              make_t, combine_t);
+    }
+    catch (...) {
+        errors[0] = std::current_exception();
+    }
+
+    for (auto& worker: workers)
+        worker.join();
+
+    // Report the failure furthest down, which is where it started.
+    for (size_t i = errors.size(); i-- != 0; )
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+
+    return result;
+}
+
+#endif // EULER67_BANDED_FOLD_H
@@ -0,0 +1,467 @@
+/******************************************************
+ *
+ *  Benchmarks for the Triangle parser and folds, run
+ *  against synthetic triangles.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "packed_triangle.h"
+#include "static_triangle.h"
+#include "overflow.h"
+#include "adaptive.h"
+#include "dispatch.h"
+#include "numa_fold.h"
+#include "soa_fold.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+/* Every generator is deterministic: the same name and height always produce
+ * the same triangle, on every platform. We use the raw output of mt19937
+ * rather than std::uniform_int_distribution because the distributions are
+ * allowed to differ between standard library implementations.
+ */
+struct Generator {
+    char const* name;
+    int (*value)(std::mt19937& rng, size_t row, size_t n);
+
+    // Path sums overflow an `int`, which is undefined behaviour in the
+    // `int` folds, so only the phases that stay exact are run.
+    bool overflows;
+};
+
+// Uniform values in [0, 100), the same range as the Project Euler input.
+int uniform_value(std::mt19937& rng, size_t, size_t)
+{
+    return static_cast<int>(rng() % 100);
+}
+
+// Every value is equal, so every comparison in the fold is a tie.
+int all_equal_value(std::mt19937&, size_t, size_t)
+{
+    return 50;
+}
+
+// Random magnitudes whose parity alternates along and between rows, so the
+// odd/even rule allows a step in one direction only at every cell.
+int alternating_parity_value(std::mt19937& rng, size_t row, size_t n)
+{
+    return static_cast<int>(2 * (rng() % 50) + ((row + n) & 1));
+}
+
+// Values so large that the path sums of all but the smallest triangles
+// overflow an `int`.
+int overflow_value(std::mt19937& rng, size_t, size_t)
+{
+    return INT_MAX - static_cast<int>(rng() % 100);
+}
+
+Generator const generators[] = {
+    { "uniform",            uniform_value,            false },
+    { "all-equal",          all_equal_value,          false },
+    { "alternating-parity", alternating_parity_value, false },
+    { "overflow",           overflow_value,           true },
+};
+
+
+Triangle generate_triangle(Generator const& generator, size_t height)
+{
+    std::mt19937 rng {static_cast<std::mt19937::result_type>(height)};
+
+    Triangle triangle;
+    for (size_t r = 0; r != height; ++r)
+    {
+        Triangle::Row row;
+        row.reserve(r + 1);
+        for (size_t n = 0; n <= r; ++n)
+            row.push_back(generator.value(rng, r, n));
+        triangle.append_row(std::move(row));
+    }
+    return triangle;
+}
+
+// Write a triangle in the text format read by `parse_triangle`.
+std::string triangle_text(Triangle const& triangle)
+{
+    std::ostringstream out;
+    for (RowView row: triangle.rows())
+    {
+        for (size_t n = 0; n != row.size(); ++n)
+            out << (n ? " " : "") << row[n];
+        out << "\n";
+    }
+    return out.str();
+}
+
+
+/* The results of running one phase `repeat` times. We report the minimum,
+ * which is the least noisy estimate of the cost, and the median.
+ */
+struct Timing {
+    double min_seconds;
+    double median_seconds;
+    long long dtlb_load_misses = -1;      // of one run, if counted
+};
+
+template <typename F>
+Timing time_phase(unsigned repeat, F&& phase)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<double> samples;
+    for (unsigned i = 0; i != repeat; ++i)
+    {
+        auto start = clock::now();
+        phase();
+        auto stop = clock::now();
+        samples.push_back(std::chrono::duration<double>(stop - start).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return Timing { samples.front(), samples[samples.size() / 2] };
+}
+
+// Results are written to a volatile so the folds cannot be optimised away.
+volatile long long sink;
+
+void report(char const* generator, size_t height, char const* phase,
+            unsigned repeat, Timing const& timing)
+{
+    double const cells = double(height) * double(height + 1) / 2;
+
+    std::cout
+        << "{\"generator\":\"" << generator << "\""
+        << ",\"height\":" << height
+        << ",\"phase\":\"" << phase << "\""
+        << ",\"repeat\":" << repeat
+        << ",\"min_seconds\":" << timing.min_seconds
+        << ",\"median_seconds\":" << timing.median_seconds
+        << ",\"ns_per_cell\":" << timing.min_seconds * 1e9 / cells;
+    if (timing.dtlb_load_misses >= 0)
+        std::cout << ",\"dtlb_load_misses\":" << timing.dtlb_load_misses;
+    std::cout << "}" << std::endl;
+}
+
+
+/* Counts the data TLB misses of loads made by this thread, through
+ * perf_event_open as in instrument.cpp. Most containers and VMs do not
+ * allow it, and then `count` returns -1 and the misses are left out of
+ * the report.
+ */
+class TlbMissCounter {
+public:
+    TlbMissCounter()
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~TlbMissCounter()
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    TlbMissCounter(TlbMissCounter const&) = delete;
+    TlbMissCounter& operator=(TlbMissCounter const&) = delete;
+
+    template <typename F>
+    long long count(F&& phase)
+    {
+        if (fd_ < 0)
+            return -1;
+
+        ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        phase();
+        ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+
+        std::uint64_t misses = 0;
+        if (::read(fd_, &misses, sizeof misses) != sizeof misses)
+            return -1;
+        return static_cast<long long>(misses);
+    }
+
+private:
+    int fd_;
+};
+
+TlbMissCounter tlb_misses;
+
+void run_benchmarks(Generator const& generator, size_t height, unsigned repeat)
+{
+    Triangle const triangle = generate_triangle(generator, height);
+    std::string const text = triangle_text(triangle);
+
+    report(generator.name, height, "parse_triangle", repeat,
+        time_phase(repeat, [&] {
+            std::istringstream stream {text};
+            sink = parse_triangle(stream).height();
+        }));
+
+    // The generic fold, with a 64-bit accumulator so that it does the same
+    // work as `max_path` without being able to overflow.
+    report(generator.name, height, "fold_triangle", repeat,
+        time_phase(repeat, [&] {
+            sink = fold_triangle<long long>(triangle,
+                [](int i) -> long long { return i; },
+                [](int i, long long left, long long right) -> long long {
+                    return i + std::max(left, right);
+                });
+        }));
+
+    // The same fold with a reused accumulator, which shows the cost of
+    // allocating one per call.
+    FoldWorkspace<long long> workspace;
+    report(generator.name, height, "fold_triangle_workspace", repeat,
+        time_phase(repeat, [&] {
+            sink = fold_triangle<long long>(triangle,
+                [](int i) -> long long { return i; },
+                [](int i, long long left, long long right) -> long long {
+                    return i + std::max(left, right);
+                },
+                workspace);
+        }));
+
+    // The overflow policies, which should cost next to nothing over the
+    // plain fold unless a sum actually overflows.
+    report(generator.name, height, "max_path_wrapping", repeat,
+        time_phase(repeat, [&] {
+            sink = max_path(triangle, OverflowPolicy::Wrapping);
+        }));
+
+    report(generator.name, height, "max_path_saturating", repeat,
+        time_phase(repeat, [&] {
+            sink = max_path(triangle, OverflowPolicy::Saturating);
+        }));
+
+    report(generator.name, height, "max_path_checked", repeat,
+        time_phase(repeat, [&] {
+            sink = max_path(triangle, OverflowPolicy::Checked);
+        }));
+
+    // Starts in 16-bit lanes and widens only as far as the sums require.
+    report(generator.name, height, "max_path_adaptive", repeat,
+        time_phase(repeat, [&] {
+            sink = max_path_adaptive(triangle).max_path;
+        }));
+
+    // Everything below folds in `int`.
+    if (generator.overflows)
+        return;
+
+    auto const fold = [&] { sink = max_path(triangle); };
+    Timing timing = time_phase(repeat, fold);
+    timing.dtlb_load_misses = tlb_misses.count(fold);
+    report(generator.name, height, "max_path", repeat, timing);
+
+    // The same fold with the values in huge pages, which needs far fewer
+    // TLB entries once the triangle is larger than a few MiB. Triangles
+    // under 2MiB (about 700 rows) are stored as before.
+    Triangle const huge {triangle, PageSize::Huge};
+    auto const fold_huge = [&] { sink = max_path(huge); };
+    timing = time_phase(repeat, fold_huge);
+    timing.dtlb_load_misses = tlb_misses.count(fold_huge);
+    report(generator.name, height, "max_path_huge_pages", repeat, timing);
+
+    // A fold with two results per cell, the maximum path value and the
+    // number of paths reaching it, kept in a vector of structs and in one
+    // array per field.
+    report(generator.name, height, "max_path_count", repeat,
+        time_phase(repeat, [&] { sink = max_path_count_aos(triangle).max_path; }));
+
+    report(generator.name, height, "max_path_count_soa", repeat,
+        time_phase(repeat, [&] { sink = max_path_count(triangle).max_path; }));
+
+    // The generic fold prefetching further and further ahead of itself,
+    // from not at all.
+    FoldWorkspace<int> int_workspace;
+    for (size_t rows: { 0, 1, 2, 4, 8 })
+    {
+        report(generator.name, height,
+            ("fold_triangle_prefetch_" + std::to_string(rows)).c_str(), repeat,
+            time_phase(repeat, [&] {
+                sink = fold_triangle<int>(triangle,
+                    [](int i) -> int { return i; }, max_path_combine,
+                    int_workspace, rows);
+            }));
+    }
+
+    report(generator.name, height, "max_odd_even_path", repeat,
+        time_phase(repeat, [&] { sink = max_odd_even_path(triangle); }));
+
+    // The column-parallel fold with one thread per CPU, with each thread's
+    // columns in its own node's memory and spread over every node. On a
+    // single-node machine the two are the same.
+    for (Placement placement: { Placement::Local, Placement::Interleaved })
+    {
+        NumaOptions options;
+        options.placement = placement;
+        NumaTriangle const numa {triangle, options};
+
+        report(generator.name, height,
+            placement == Placement::Local ? "max_path_numa_local"
+                                          : "max_path_numa_interleaved",
+            repeat, time_phase(repeat, [&] { sink = max_path(numa); }));
+    }
+
+    // The dispatched kernels at every level this CPU supports, and the
+    // batch kernel over a hundred references to the same triangle, which
+    // shows the per-triangle overhead on small heights.
+    for (IsaLevel level: { IsaLevel::Scalar, IsaLevel::Sse42,
+                           IsaLevel::Avx2, IsaLevel::Avx512 })
+    {
+        if (level > detected_isa_level())
+            break;
+
+        FoldKernels const& kernels = fold_kernels(level);
+        std::string const suffix = std::string("_") + isa_name(level);
+        std::vector<Triangle const*> const batch(100, &triangle);
+        std::vector<int> max_paths(batch.size()), odd_even_paths(batch.size());
+
+        report(generator.name, height, ("max_path" + suffix).c_str(), repeat,
+            time_phase(repeat, [&] { sink = kernels.max_path(triangle); }));
+
+        report(generator.name, height, ("solve_batch_x100" + suffix).c_str(), repeat,
+            time_phase(repeat, [&] {
+                kernels.solve_batch(batch.data(), batch.size(),
+                                    max_paths.data(), odd_even_paths.data());
+                sink = max_paths.front();
+            }));
+    }
+
+    // The same folds over the bit-packed representation, which read far
+    // less memory for small values.
+    PackedTriangle const packed {triangle};
+
+    report(generator.name, height, "max_path_packed", repeat,
+        time_phase(repeat, [&] { sink = max_path(packed); }));
+
+    report(generator.name, height, "max_odd_even_path_packed", repeat,
+        time_phase(repeat, [&] { sink = max_odd_even_path(packed); }));
+
+    // The Problem 67 shape also has a fixed-height version whose fold is
+    // unrolled at compile time. A single call is too short to time, so
+    // this phase times a thousand calls.
+    if (height == 100)
+    {
+        StaticTriangle<100> const fixed {triangle};
+
+        report(generator.name, height, "max_path_static_x1000", repeat,
+            time_phase(repeat, [&] {
+                for (int i = 0; i != 1000; ++i)
+                    sink = max_path(fixed);
+            }));
+
+        report(generator.name, height, "max_path_x1000", repeat,
+            time_phase(repeat, [&] {
+                for (int i = 0; i != 1000; ++i)
+                    sink = max_path(triangle);
+            }));
+    }
+}
+
+
+std::vector<std::string> split(std::string const& list)
+{
+    std::vector<std::string> items;
+    std::istringstream stream {list};
+    std::string item;
+    while (std::getline(stream, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+int usage()
+{
+    std::cerr
+        << "usage: bench [--heights H,H,...] [--generators G,G,...]"
+           " [--repeat N]\n"
+        << "\n"
+        << "Generators: uniform, all-equal, alternating-parity, overflow.\n"
+        << "Heights default to 100,1000,10000. A height of 1e6 is accepted,\n"
+        << "but a Triangle of that size needs about 2TB of memory.\n"
+        << "Results are printed as one JSON object per line.\n";
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> heights { 100, 1000, 10000 };
+    std::vector<Generator> selected(std::begin(generators),
+                                    std::end(generators));
+    unsigned repeat = 5;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg = argv[i];
+        if (i + 1 == argc)
+            return usage();
+
+        if (arg == "--heights")
+        {
+            heights.clear();
+            for (auto const& h: split(argv[++i]))
+                heights.push_back(static_cast<size_t>(std::strtod(h.c_str(), nullptr)));
+        }
+        else if (arg == "--generators")
+        {
+            selected.clear();
+            for (auto const& name: split(argv[++i]))
+            {
+                auto found = std::find_if(
+                    std::begin(generators), std::end(generators),
+                    [&name](Generator const& g) { return name == g.name; });
+                if (found == std::end(generators))
+                {
+                    std::cerr << "bench: unknown generator " << name << "\n";
+                    return usage();
+                }
+                selected.push_back(*found);
+            }
+        }
+        else if (arg == "--repeat")
+        {
+            repeat = static_cast<unsigned>(std::atoi(argv[++i]));
+        }
+        else
+        {
+            return usage();
+        }
+    }
+
+    if (repeat == 0 || std::count(heights.begin(), heights.end(), 0u))
+        return usage();
+
+    for (auto const& generator: selected)
+        for (size_t height: heights)
+            run_benchmarks(generator, height, repeat);
+}
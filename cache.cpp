@@ -0,0 +1,115 @@
+/******************************************************
+ *
+ *  A content-addressed cache of solved triangles.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "cache.h"
+
+#include <cstdio>         // std::rename
+#include <fstream>
+#include <sstream>
+#include <stdexcept>      // std::runtime_error, std::invalid_argument
+
+
+namespace {
+
+/* The first line of a cache file. Bump the version if the format changes.
+ */
+char const* const cache_header = "euler67-cache 1";
+
+} // namespace
+
+
+ResultCache::ResultCache(size_t capacity)
+    : capacity_(capacity)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument(
+            "ResultCache requires a capacity of at least one entry");
+    }
+}
+
+SolvedTriangle const* ResultCache::lookup(ContentKey const& key)
+{
+    auto found = index_.find(key);
+    if (found == index_.end())
+        return nullptr;
+
+    // Move the entry to the front without invalidating any iterators.
+    entries_.splice(entries_.begin(), entries_, found->second);
+    return &found->second->second;
+}
+
+void ResultCache::insert(ContentKey const& key, SolvedTriangle const& solved)
+{
+    auto found = index_.find(key);
+    if (found != index_.end())
+    {
+        found->second->second = solved;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return;
+    }
+
+    if (entries_.size() == capacity_)
+    {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+
+    entries_.emplace_front(key, solved);
+    index_[key] = entries_.begin();
+}
+
+void ResultCache::load(std::string const& path)
+{
+    std::ifstream file {path};
+    if (!file.is_open())
+        return;
+
+    std::string line;
+    if (!std::getline(file, line) || line != cache_header)
+        throw std::runtime_error(path + " is not a result cache file");
+
+    // Entries are stored oldest first, so inserting them in order leaves
+    // the most recently used entry at the front again.
+    while (std::getline(file, line))
+    {
+        std::istringstream fields {line};
+        ContentKey key;
+        SolvedTriangle solved;
+        if (!(fields >> std::hex >> key.hash >> std::dec
+                     >> key.length >> solved.height
+                     >> solved.max_path >> solved.max_odd_even_path))
+        {
+            throw std::runtime_error("malformed entry in " + path);
+        }
+        insert(key, solved);
+    }
+}
+
+void ResultCache::save(std::string const& path) const
+{
+    std::string const temp_path = path + ".tmp";
+    {
+        std::ofstream file {temp_path};
+        file << cache_header << "\n";
+        for (auto entry = entries_.rbegin(); entry != entries_.rend(); ++entry)
+        {
+            file << std::hex << entry->first.hash << std::dec << " "
+                 << entry->first.length << " "
+                 << entry->second.height << " "
+                 << entry->second.max_path << " "
+                 << entry->second.max_odd_even_path << "\n";
+        }
+        if (!file.flush())
+            throw std::runtime_error("cannot write " + temp_path);
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("cannot replace " + path);
+}
@@ -0,0 +1,142 @@
+/******************************************************
+ *
+ *  A content-addressed cache of solved triangles.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_CACHE_H
+#define EULER67_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+
+/* What the cache is keyed by: a 64-bit FNV-1a hash of the text of a
+ * triangle file, and the number of bytes hashed. Two different files only
+ * share a key if they have the same length and their hashes collide.
+ */
+struct ContentKey {
+    std::uint64_t hash;
+    std::uint64_t length;
+
+    bool operator==(ContentKey const& other) const
+    {
+        return hash == other.hash && length == other.length;
+    }
+};
+
+struct ContentKeyHash {
+    size_t operator()(ContentKey const& key) const
+    {
+        return static_cast<size_t>(key.hash ^ (key.length * 0x9e3779b97f4a7c15ull));
+    }
+};
+
+/* Computes a ContentKey a piece at a time, so that a file can be hashed as
+ * it is read.
+ *
+ * This is not a cryptographic hash, it only needs to be fast and to spread
+ * different triangles apart. The hash is defined over the file's lines,
+ * each followed by '\n', so a file with or without a trailing newline
+ * hashes the same (just as `parse_triangle` reads them the same): call
+ * `finish` after the last piece.
+ */
+class ContentHash {
+public:
+    void update(char const* data, size_t size)
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            state_ ^= static_cast<unsigned char>(data[i]);
+            state_ *= 0x100000001b3ull;
+        }
+        length_ += size;
+        if (size != 0)
+            last_ = data[size - 1];
+    }
+
+    /* The key of everything passed to `update`, ended with a newline if
+     * it did not end with one.
+     */
+    ContentKey finish()
+    {
+        if (length_ != 0 && last_ != '\n')
+            update("\n", 1);
+        return ContentKey { state_, length_ };
+    }
+
+private:
+    std::uint64_t state_ = 0xcbf29ce484222325ull;
+    std::uint64_t length_ = 0;
+    char last_ = '\n';
+};
+
+/* The key of the complete text of a triangle file held in memory.
+ */
+inline ContentKey hash_triangle_text(std::string const& text)
+{
+    ContentHash hash;
+    hash.update(text.data(), text.size());
+    return hash.finish();
+}
+
+
+/* The results we memoize for a triangle.
+ */
+struct SolvedTriangle {
+    size_t height;
+    int max_path;
+    int max_odd_even_path;
+};
+
+
+/* A bounded cache from content keys to solved triangles. When the cache
+ * is full, the least recently used entry is evicted.
+ *
+ * The cache can be saved to and loaded from a small text file so that the
+ * results survive between runs of the program.
+ */
+class ResultCache {
+public:
+    explicit ResultCache(size_t capacity = 1024);
+
+    /* Find the results for a key, marking the entry as recently used.
+     * Returns nullptr on a miss. The pointer is invalidated by `insert`.
+     */
+    SolvedTriangle const* lookup(ContentKey const& key);
+
+    /* Record the results for a key, evicting the oldest entry if needed.
+     */
+    void insert(ContentKey const& key, SolvedTriangle const& solved);
+
+    size_t size() const { return entries_.size(); }
+    size_t capacity() const { return capacity_; }
+
+    /* Load entries saved by `save`. A missing file is not an error (there
+     * is simply nothing cached yet), but a malformed one throws
+     * std::runtime_error.
+     */
+    void load(std::string const& path);
+
+    /* Write every entry to `path`, oldest first, so that loading the file
+     * restores the same recency order. The file is replaced atomically.
+     */
+    void save(std::string const& path) const;
+
+private:
+    using Entry = std::pair<ContentKey, SolvedTriangle>;
+
+    size_t capacity_;
+
+    // Most recently used at the front.
+    std::list<Entry> entries_;
+    std::unordered_map<ContentKey, std::list<Entry>::iterator, ContentKeyHash> index_;
+};
+
+#endif // EULER67_CACHE_H
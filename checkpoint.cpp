@@ -0,0 +1,226 @@
+/******************************************************
+ *
+ *  Checkpoints of a fold in progress, so that a long
+ *  out-of-core fold can resume after a crash.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "checkpoint.h"
+
+#include <cerrno>
+#include <cstdio>         // std::rename
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace {
+
+char const checkpoint_magic[8] = { 'E', 'U', 'L', 'E', 'R', '6', '7', 'C' };
+std::uint32_t const checkpoint_version = 1;
+size_t const checkpoint_header_size = 48;
+
+void put_le(unsigned char* p, std::uint64_t v, int bytes)
+{
+    for (int i = 0; i != bytes; ++i)
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+std::uint64_t get_le(unsigned char const* p, int bytes)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i != bytes; ++i)
+        v |= std::uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+std::uint64_t fnv1a(std::vector<unsigned char> const& bytes)
+{
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char byte: bytes)
+    {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string errno_message(std::string const& what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+void write_all(int fd, unsigned char const* data, size_t size,
+               std::string const& path)
+{
+    while (size != 0)
+    {
+        ssize_t wrote = ::write(fd, data, size);
+        if (wrote < 0 && errno == EINTR)
+            continue;
+        if (wrote < 0)
+            throw std::runtime_error(errno_message("cannot write " + path));
+        data += wrote;
+        size -= static_cast<size_t>(wrote);
+    }
+}
+
+/* Write `checkpoint` to a temporary file, make it durable, then rename it
+ * over `path`.
+ */
+void write_checkpoint(std::string const& path, Checkpoint const& checkpoint)
+{
+    unsigned char header[checkpoint_header_size] = {};
+    std::memcpy(header, checkpoint_magic, sizeof checkpoint_magic);
+    put_le(header + 8, checkpoint_version, 4);
+    put_le(header + 12, checkpoint.value_size, 4);
+    put_le(header + 16, checkpoint.height, 8);
+    put_le(header + 24, checkpoint.row, 8);
+    put_le(header + 32, checkpoint.source, 8);
+    put_le(header + 40, fnv1a(checkpoint.accum), 8);
+
+    std::string const temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw std::runtime_error(errno_message("cannot create " + temp_path));
+
+    try {
+        write_all(fd, header, sizeof header, temp_path);
+        write_all(fd, checkpoint.accum.data(), checkpoint.accum.size(),
+                  temp_path);
+        if (::fsync(fd) != 0)
+            throw std::runtime_error(errno_message("cannot sync " + temp_path));
+    }
+    catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+        throw std::runtime_error(errno_message("cannot replace " + path));
+}
+
+} // namespace
+
+
+bool load_checkpoint(std::string const& path, Checkpoint& checkpoint)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT)
+        return false;
+    if (fd < 0)
+        throw std::runtime_error(errno_message("cannot open " + path));
+
+    std::vector<unsigned char> bytes;
+    unsigned char buffer[1 << 16];
+    for (;;)
+    {
+        ssize_t got = ::read(fd, buffer, sizeof buffer);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+        {
+            std::string const message = errno_message("cannot read " + path);
+            ::close(fd);
+            throw std::runtime_error(message);
+        }
+        if (got == 0)
+            break;
+        bytes.insert(bytes.end(), buffer, buffer + got);
+    }
+    ::close(fd);
+
+    if (bytes.size() < checkpoint_header_size
+        || std::memcmp(bytes.data(), checkpoint_magic, sizeof checkpoint_magic) != 0)
+        throw std::runtime_error(path + " is not a checkpoint");
+    if (get_le(bytes.data() + 8, 4) != checkpoint_version)
+        throw std::runtime_error(path + " has an unsupported checkpoint version");
+
+    checkpoint.value_size = static_cast<std::uint32_t>(get_le(bytes.data() + 12, 4));
+    checkpoint.height = get_le(bytes.data() + 16, 8);
+    checkpoint.row = get_le(bytes.data() + 24, 8);
+    checkpoint.source = get_le(bytes.data() + 32, 8);
+    checkpoint.accum.assign(bytes.begin() + checkpoint_header_size, bytes.end());
+
+    if (checkpoint.row >= checkpoint.height
+        || checkpoint.accum.size() !=
+               (checkpoint.row + 1) * std::uint64_t(checkpoint.value_size)
+        || fnv1a(checkpoint.accum) != get_le(bytes.data() + 40, 8))
+        throw std::runtime_error(path + " is a damaged checkpoint");
+
+    return true;
+}
+
+
+CheckpointWriter::CheckpointWriter(std::string path)
+    : path_(std::move(path))
+{
+    thread_ = std::thread([this] { run(); });
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    finish();
+}
+
+void CheckpointWriter::submit(Checkpoint checkpoint)
+{
+    {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (error_)
+        {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+        pending_ = std::move(checkpoint);
+        has_pending_ = true;
+    }
+    changed_.notify_one();
+}
+
+void CheckpointWriter::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock {mutex_};
+        stopping_ = true;
+    }
+    changed_.notify_one();
+
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void CheckpointWriter::run()
+{
+    std::unique_lock<std::mutex> lock {mutex_};
+    for (;;)
+    {
+        changed_.wait(lock, [this] { return has_pending_ || stopping_; });
+        if (!has_pending_)
+            return;
+
+        Checkpoint checkpoint = std::move(pending_);
+        has_pending_ = false;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            write_checkpoint(path_, checkpoint);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (error && !error_)
+            error_ = error;
+    }
+}
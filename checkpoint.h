@@ -0,0 +1,103 @@
+/******************************************************
+ *
+ *  Checkpoints of a fold in progress, so that a long
+ *  out-of-core fold can resume after a crash.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_CHECKPOINT_H
+#define EULER67_CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* The state of a bottom-up fold after it has folded row `row`: the first
+ * `row + 1` values of the accumulator, as raw bytes.
+ *
+ * On disk a checkpoint is a 48-byte header followed by the accumulator:
+ *
+ *     offset  size  contents
+ *          0     8  magic "EULER67C"
+ *          8     4  format version (1)
+ *         12     4  value_size, the size of one accumulator value
+ *         16     8  height of the triangle being folded
+ *         24     8  row
+ *         32     8  source, the identity of the triangle file
+ *         40     8  FNV-1a hash of the accumulator bytes
+ *         48   ...  accumulator
+ *
+ * A checkpoint belongs to one triangle and one fold. Use a separate file
+ * for each fold of the same triangle. `source` identifies the file the
+ * triangle was read from (see `ReverseRowReader::identity`), so that a
+ * checkpoint is never resumed against another triangle of the same height,
+ * or against the same path after the file was rewritten.
+ */
+struct Checkpoint {
+    std::uint32_t value_size = 0;
+    std::uint64_t height = 0;
+    std::uint64_t row = 0;
+    std::uint64_t source = 0;
+    std::vector<unsigned char> accum;
+};
+
+/* Read the checkpoint at `path` into `checkpoint`. Returns false if there
+ * is no such file, and throws std::runtime_error if the file is not a
+ * whole, valid checkpoint.
+ */
+bool load_checkpoint(std::string const& path, Checkpoint& checkpoint);
+
+
+/* Writes checkpoints on a background thread, so that the fold only pays
+ * for copying its accumulator.
+ *
+ * `submit` hands a checkpoint to the writer and returns at once. If the
+ * writer is still busy with an earlier one, the newest waiting checkpoint
+ * replaces any older one that has not been started, since only the latest
+ * is of any use. Each checkpoint is written to a temporary file, flushed to
+ * disk and renamed over `path`, so a crash never leaves a torn checkpoint.
+ *
+ * A write that fails is reported by the next `submit`, which throws
+ * std::runtime_error, so that a long fold stops while its last good
+ * checkpoint is still on disk instead of running on unprotected.
+ */
+class CheckpointWriter {
+public:
+    explicit CheckpointWriter(std::string path);
+    ~CheckpointWriter();
+
+    CheckpointWriter(CheckpointWriter const&) = delete;
+    CheckpointWriter& operator=(CheckpointWriter const&) = delete;
+
+    void submit(Checkpoint checkpoint);
+
+    /* Wait for the last submitted checkpoint to be written and stop the
+     * thread. Does not throw: once the fold is complete its checkpoints no
+     * longer matter, so a failed write must not hide the result.
+     */
+    void finish();
+
+private:
+    std::string path_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    Checkpoint pending_;
+    bool has_pending_ = false;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+
+    std::thread thread_;
+
+    void run();
+};
+
+#endif // EULER67_CHECKPOINT_H
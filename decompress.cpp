@@ -0,0 +1,240 @@
+/******************************************************
+ *
+ *  Streaming decompression of gzip and zstd triangle
+ *  files, running on its own thread.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "decompress.h"
+
+#include <algorithm>      // std::min
+#include <istream>
+#include <stdexcept>
+
+#ifdef EULER67_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef EULER67_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+
+// Each block handed to the reader holds this much decompressed text, and
+// the decoder runs at most this many blocks ahead of the reader.
+size_t const block_size = 256 * 1024;
+size_t const max_queued_blocks = 4;
+
+bool starts_with(char const* data, size_t size,
+                 unsigned char const* magic, size_t magic_size)
+{
+    if (size < magic_size)
+        return false;
+    for (size_t i = 0; i != magic_size; ++i)
+        if (static_cast<unsigned char>(data[i]) != magic[i])
+            return false;
+    return true;
+}
+
+} // namespace
+
+
+Compression detect_compression(char const* data, size_t size)
+{
+    static unsigned char const gzip_magic[] = { 0x1f, 0x8b };
+    static unsigned char const zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    if (starts_with(data, size, gzip_magic, sizeof gzip_magic))
+        return Compression::Gzip;
+    if (starts_with(data, size, zstd_magic, sizeof zstd_magic))
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+
+DecompressingStreambuf::DecompressingStreambuf(char const* data, size_t size,
+                                               Compression format)
+{
+    decoder_ = std::thread([=] { decode(data, size, format); });
+}
+
+DecompressingStreambuf::~DecompressingStreambuf()
+{
+    {
+        std::lock_guard<std::mutex> lock {mutex_};
+        cancelled_ = true;
+    }
+    changed_.notify_all();
+    decoder_.join();
+}
+
+void DecompressingStreambuf::check() const
+{
+    std::lock_guard<std::mutex> lock {mutex_};
+    if (!error_.empty())
+        throw std::runtime_error(error_);
+}
+
+DecompressingStreambuf::int_type DecompressingStreambuf::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+
+    {
+        std::unique_lock<std::mutex> lock {mutex_};
+        changed_.wait(lock, [this] { return !blocks_.empty() || finished_; });
+        if (blocks_.empty())
+            return traits_type::eof();
+
+        current_ = std::move(blocks_.front());
+        blocks_.pop_front();
+    }
+    changed_.notify_all();
+
+    char* begin = &current_[0];
+    setg(begin, begin, begin + current_.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+bool DecompressingStreambuf::push_block(std::string&& block)
+{
+    std::unique_lock<std::mutex> lock {mutex_};
+    changed_.wait(lock, [this] {
+        return blocks_.size() < max_queued_blocks || cancelled_;
+    });
+    if (cancelled_)
+        return false;
+
+    blocks_.push_back(std::move(block));
+    lock.unlock();
+    changed_.notify_all();
+    return true;
+}
+
+void DecompressingStreambuf::decode(char const* data, size_t size,
+                                    Compression format)
+{
+    std::string error;
+
+    try {
+        std::string block;
+
+        if (format == Compression::None)
+        {
+            for (size_t offset = 0; offset < size; offset += block_size)
+            {
+                block.assign(data + offset, std::min(block_size, size - offset));
+                if (!push_block(std::move(block)))
+                    break;
+            }
+        }
+        else if (format == Compression::Gzip)
+        {
+#ifdef EULER67_HAVE_ZLIB
+            z_stream zs {};
+            // 15 window bits, +32 to accept both gzip and zlib headers.
+            if (inflateInit2(&zs, 15 + 32) != Z_OK)
+                throw std::runtime_error("inflateInit2 failed");
+
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            zs.avail_in = static_cast<uInt>(size);
+
+            int status = Z_OK;
+            while (status != Z_STREAM_END || zs.avail_in != 0)
+            {
+                // A file may hold several gzip members back to back.
+                if (status == Z_STREAM_END)
+                    inflateReset(&zs);
+
+                block.resize(block_size);
+                zs.next_out = reinterpret_cast<Bytef*>(&block[0]);
+                zs.avail_out = static_cast<uInt>(block.size());
+
+                status = inflate(&zs, Z_NO_FLUSH);
+                if (status != Z_OK && status != Z_STREAM_END)
+                {
+                    error = "corrupt or truncated gzip data";
+                    break;
+                }
+
+                block.resize(block.size() - zs.avail_out);
+                if (!block.empty() && !push_block(std::move(block)))
+                    break;
+            }
+            inflateEnd(&zs);
+#else
+            error = "this build has no gzip support (zlib was not found)";
+#endif
+        }
+        else
+        {
+#ifdef EULER67_HAVE_ZSTD
+            ZSTD_DStream* zs = ZSTD_createDStream();
+            ZSTD_inBuffer in { data, size, 0 };
+
+            size_t remaining = 1;
+            while (in.pos < in.size)
+            {
+                block.resize(block_size);
+                ZSTD_outBuffer out { &block[0], block.size(), 0 };
+
+                remaining = ZSTD_decompressStream(zs, &out, &in);
+                if (ZSTD_isError(remaining))
+                {
+                    error = std::string("zstd: ")
+                          + ZSTD_getErrorName(remaining);
+                    break;
+                }
+
+                block.resize(out.pos);
+                if (!block.empty() && !push_block(std::move(block)))
+                    break;
+            }
+            if (error.empty() && remaining != 0)
+                error = "truncated zstd data";
+            ZSTD_freeDStream(zs);
+#else
+            error = "this build has no zstd support (libzstd was not found)";
+#endif
+        }
+    }
+    catch (std::exception const& e) {
+        error = e.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock {mutex_};
+        finished_ = true;
+        error_ = error;
+    }
+    changed_.notify_all();
+}
+
+
+Triangle parse_triangle_file_contents(std::string const& contents)
+{
+    Compression const format =
+        detect_compression(contents.data(), contents.size());
+
+    if (format == Compression::None)
+        return parse_triangle(contents.data(), contents.size());
+
+    DecompressingStreambuf buffer {contents.data(), contents.size(), format};
+    std::istream stream {&buffer};
+
+    // If decoding failed, the parser most likely choked on the cut-off
+    // text, but the decoder's error is the one worth reporting.
+    try {
+        Triangle triangle = parse_triangle(stream);
+        buffer.check();
+        return triangle;
+    }
+    catch (std::invalid_argument const&) {
+        buffer.check();
+        throw;
+    }
+}
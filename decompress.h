@@ -0,0 +1,84 @@
+/******************************************************
+ *
+ *  Streaming decompression of gzip and zstd triangle
+ *  files, running on its own thread.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_DECOMPRESS_H
+#define EULER67_DECOMPRESS_H
+
+#include "triangle.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+
+/* Support for each format is compiled in when its library is found at
+ * build time (EULER67_HAVE_ZLIB and EULER67_HAVE_ZSTD, set by the makefile).
+ */
+enum class Compression { None, Gzip, Zstd };
+
+/* Recognise a compressed file by its magic number.
+ */
+Compression detect_compression(char const* data, size_t size);
+
+
+/* A read-only streambuf that decompresses a buffer on a separate thread.
+ *
+ * The decoder thread inflates the input into fixed-size blocks and passes
+ * them through a small bounded queue, and `underflow` hands each block to
+ * the reader in turn. Whatever reads the stream (such as `parse_triangle`)
+ * therefore tokenizes one block while the next is being decoded, and the
+ * whole decompressed text never exists in memory at once.
+ *
+ * The compressed input must outlive the streambuf.
+ */
+class DecompressingStreambuf : public std::streambuf {
+public:
+    DecompressingStreambuf(char const* data, size_t size, Compression format);
+    ~DecompressingStreambuf();
+
+    DecompressingStreambuf(DecompressingStreambuf const&) = delete;
+    DecompressingStreambuf& operator=(DecompressingStreambuf const&) = delete;
+
+    /* A corrupt or truncated input ends the stream early, which a reader
+     * cannot tell apart from a short file. Call this after reading to
+     * throw std::runtime_error if decoding failed.
+     */
+    void check() const;
+
+protected:
+    int_type underflow() override;
+
+private:
+    // The queue between the decoder thread and the reader.
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::string> blocks_;
+    bool finished_ = false;     // the decoder has pushed its last block
+    bool cancelled_ = false;    // the reader has gone away
+    std::string error_;
+
+    std::string current_;       // the block being read
+    std::thread decoder_;
+
+    // Returns false if the reader has cancelled decoding.
+    bool push_block(std::string&& block);
+    void decode(char const* data, size_t size, Compression format);
+};
+
+
+/* Parse a triangle file held in memory, decompressing it on the fly first
+ * if it is gzip or zstd compressed.
+ */
+Triangle parse_triangle_file_contents(std::string const& contents);
+
+#endif // EULER67_DECOMPRESS_H
@@ -0,0 +1,418 @@
+/******************************************************
+ *
+ *  Chooses the fastest fold kernels the CPU supports,
+ *  once, when the program starts.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "dispatch.h"
+
+#include <cstdlib>        // std::getenv
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EULER67_DISPATCH_X86 1
+#endif
+
+
+namespace {
+
+using RowKernel = void (*)(int*, int const*, size_t);
+
+/* A top kernel folds the top `rows` rows of `triangle`, where `rows` is at
+ * most `top_rows`, into `accum`, which holds the `rows + 1` results of the
+ * row below them, and returns the apex.
+ */
+using TopKernel = int (*)(int*, Triangle const&, size_t);
+
+size_t const top_rows = 15;
+
+template <RowKernel Row>
+int fold_top(int* accum, Triangle const& triangle, size_t rows)
+{
+    for (size_t r = rows; r-- != 0; )
+        Row(accum, triangle.row(r).data(), r + 1);
+    return accum[0];
+}
+
+
+/* Scalar kernels, which run anywhere.
+ */
+void max_path_row_scalar(int* accum, int const* values, size_t size)
+{
+    for (size_t i = 0; i != size; ++i)
+        accum[i] = max_path_combine(values[i], accum[i], accum[i + 1]);
+}
+
+void odd_even_path_row_scalar(int* accum, int const* values, size_t size)
+{
+    for (size_t i = 0; i != size; ++i)
+        accum[i] = odd_even_path_combine(values[i], accum[i], accum[i + 1]);
+}
+
+
+#ifdef EULER67_DISPATCH_X86
+
+/* Each SIMD kernel folds as many whole vectors as fit in the row and
+ * finishes with the scalar kernel. Storing results i..i+k-1 before loading
+ * results i+k onwards is safe, since every result only reads the results
+ * at its own position and the next one.
+ *
+ * The odd/even selection is the same as `odd_even_path_combine`: `left` is
+ * kept only where it is odd and `right` only where it is even.
+ */
+__attribute__((target("sse4.2")))
+void max_path_row_sse42(int* accum, int const* values, size_t size)
+{
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i const left = _mm_loadu_si128(reinterpret_cast<__m128i const*>(accum + i));
+        __m128i const right = _mm_loadu_si128(reinterpret_cast<__m128i const*>(accum + i + 1));
+        __m128i const value = _mm_loadu_si128(reinterpret_cast<__m128i const*>(values + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(accum + i),
+                         _mm_add_epi32(value, _mm_max_epi32(left, right)));
+    }
+    max_path_row_scalar(accum + i, values + i, size - i);
+}
+
+__attribute__((target("sse4.2")))
+void odd_even_path_row_sse42(int* accum, int const* values, size_t size)
+{
+    __m128i const one = _mm_set1_epi32(1);
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        __m128i const left = _mm_loadu_si128(reinterpret_cast<__m128i const*>(accum + i));
+        __m128i const right = _mm_loadu_si128(reinterpret_cast<__m128i const*>(accum + i + 1));
+        __m128i const value = _mm_loadu_si128(reinterpret_cast<__m128i const*>(values + i));
+
+        __m128i const left_odd = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(left, one));
+        __m128i const right_even = _mm_sub_epi32(_mm_and_si128(right, one), one);
+        __m128i const best = _mm_max_epi32(_mm_and_si128(left, left_odd),
+                                           _mm_and_si128(right, right_even));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(accum + i),
+                         _mm_add_epi32(value, best));
+    }
+    odd_even_path_row_scalar(accum + i, values + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void max_path_row_avx2(int* accum, int const* values, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(accum + i + 1));
+        __m256i const value = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i),
+                            _mm256_add_epi32(value, _mm256_max_epi32(left, right)));
+    }
+    max_path_row_scalar(accum + i, values + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void odd_even_path_row_avx2(int* accum, int const* values, size_t size)
+{
+    __m256i const one = _mm256_set1_epi32(1);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(accum + i + 1));
+        __m256i const value = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values + i));
+
+        __m256i const left_odd = _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(left, one));
+        __m256i const right_even = _mm256_sub_epi32(_mm256_and_si256(right, one), one);
+        __m256i const best = _mm256_max_epi32(_mm256_and_si256(left, left_odd),
+                                              _mm256_and_si256(right, right_even));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i),
+                            _mm256_add_epi32(value, best));
+    }
+    odd_even_path_row_scalar(accum + i, values + i, size - i);
+}
+
+
+/* The AVX-512 kernels have no scalar tail. The last, partial vector of a
+ * row is loaded and stored under a mask of its lanes, so a row of any
+ * length takes ceil(size / 16) iterations; this matters because half the
+ * rows of a triangle are shorter than its height / 2, and every row of a
+ * small one is short. Masked-off lanes are neither read nor written, so
+ * nothing past `accum[size]` or `values[size - 1]` is touched.
+ *
+ * The unmasked operations are written as `maskz` ones with every lane set,
+ * because GCC 12 warns about the undefined vector the plain intrinsics
+ * pass to the builtins.
+ */
+__attribute__((target("avx512f")))
+inline __mmask16 row_mask(size_t remaining)
+{
+    return remaining >= 16 ? __mmask16(0xFFFF)
+                           : __mmask16((1u << remaining) - 1);
+}
+
+__attribute__((target("avx512f")))
+void max_path_row_avx512(int* accum, int const* values, size_t size)
+{
+    for (size_t i = 0; i < size; i += 16)
+    {
+        __mmask16 const mask = row_mask(size - i);
+        __m512i const left = _mm512_maskz_loadu_epi32(mask, accum + i);
+        __m512i const right = _mm512_maskz_loadu_epi32(mask, accum + i + 1);
+        __m512i const value = _mm512_maskz_loadu_epi32(mask, values + i);
+        _mm512_mask_storeu_epi32(accum + i, mask,
+                                 _mm512_add_epi32(value, _mm512_maskz_max_epi32(mask, left, right)));
+    }
+}
+
+// With mask registers the odd/even selection is a test and two zeroing
+// moves rather than the arithmetic masks of the narrower kernels.
+__attribute__((target("avx512f")))
+void odd_even_path_row_avx512(int* accum, int const* values, size_t size)
+{
+    __m512i const one = _mm512_set1_epi32(1);
+
+    for (size_t i = 0; i < size; i += 16)
+    {
+        __mmask16 const mask = row_mask(size - i);
+        __m512i const left = _mm512_maskz_loadu_epi32(mask, accum + i);
+        __m512i const right = _mm512_maskz_loadu_epi32(mask, accum + i + 1);
+        __m512i const value = _mm512_maskz_loadu_epi32(mask, values + i);
+
+        __mmask16 const left_odd = _mm512_test_epi32_mask(left, one);
+        __mmask16 const right_even = _mm512_testn_epi32_mask(right, one);
+        __m512i const best = _mm512_maskz_max_epi32(mask,
+                                                    _mm512_maskz_mov_epi32(left_odd, left),
+                                                    _mm512_maskz_mov_epi32(right_even, right));
+        _mm512_mask_storeu_epi32(accum + i, mask, _mm512_add_epi32(value, best));
+    }
+}
+
+/* Each row is stored and then reloaded, one lane along, by the next row,
+ * which the CPU cannot forward from its store buffer. That stall costs
+ * more than the whole of a short row, so the top rows, whose results fit
+ * in one register, stay in it: the results to the right are the register
+ * shifted down one lane. Lanes past the end of a row hold garbage, but a
+ * valid lane only ever reads valid lanes.
+ */
+__attribute__((target("avx512f")))
+int max_path_top_avx512(int* accum, Triangle const& triangle, size_t rows)
+{
+    __m512i results = _mm512_maskz_loadu_epi32(row_mask(rows + 1), accum);
+    for (size_t r = rows; r-- != 0; )
+    {
+        __m512i const right = _mm512_maskz_alignr_epi32(0xFFFF, results, results, 1);
+        __m512i const value = _mm512_maskz_loadu_epi32(
+            row_mask(r + 1), triangle.row(r).data());
+        results = _mm512_add_epi32(value,
+                                   _mm512_maskz_max_epi32(0xFFFF, results, right));
+    }
+    return _mm512_cvtsi512_si32(results);
+}
+
+__attribute__((target("avx512f")))
+int odd_even_path_top_avx512(int* accum, Triangle const& triangle, size_t rows)
+{
+    __m512i const one = _mm512_set1_epi32(1);
+
+    __m512i results = _mm512_maskz_loadu_epi32(row_mask(rows + 1), accum);
+    for (size_t r = rows; r-- != 0; )
+    {
+        __m512i const right = _mm512_maskz_alignr_epi32(0xFFFF, results, results, 1);
+        __m512i const value = _mm512_maskz_loadu_epi32(
+            row_mask(r + 1), triangle.row(r).data());
+
+        __mmask16 const left_odd = _mm512_test_epi32_mask(results, one);
+        __mmask16 const right_even = _mm512_testn_epi32_mask(right, one);
+        __m512i const best = _mm512_maskz_max_epi32(0xFFFF,
+                                                    _mm512_maskz_mov_epi32(left_odd, results),
+                                                    _mm512_maskz_mov_epi32(right_even, right));
+        results = _mm512_add_epi32(value, best);
+    }
+    return _mm512_cvtsi512_si32(results);
+}
+
+#endif // EULER67_DISPATCH_X86
+
+
+/* The whole fold, with the kernels fixed at compile time so that the batch
+ * loops call them directly.
+ */
+template <RowKernel Row, TopKernel Top>
+int fold_with(Triangle const& triangle, std::vector<int>& accum)
+{
+    RowView const leaves = triangle.rows().back();
+    accum.assign(leaves.begin(), leaves.end());
+
+    size_t r = triangle.height() - 1;
+    for (; r > top_rows; --r)
+        Row(accum.data(), triangle.row(r - 1).data(), r);
+    return Top(accum.data(), triangle, r);
+}
+
+template <RowKernel Row, TopKernel Top>
+int fold_triangle_with(Triangle const& triangle)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle expects a non-empty triangle");
+    }
+    return fold_with<Row, Top>(triangle,
+                               thread_workspace<int>().accum(triangle.width()));
+}
+
+template <RowKernel MaxRow, TopKernel MaxTop,
+          RowKernel OddEvenRow, TopKernel OddEvenTop>
+void solve_batch_with(Triangle const* const* triangles, size_t count,
+                      int* max_paths, int* odd_even_paths)
+{
+    for (size_t i = 0; i != count; ++i)
+    {
+        Triangle const& triangle = *triangles[i];
+        if (triangle.height() == 0) {
+            throw std::invalid_argument(
+                "fold_triangle expects a non-empty triangle");
+        }
+
+        std::vector<int>& accum = thread_workspace<int>().accum(triangle.width());
+        max_paths[i] = fold_with<MaxRow, MaxTop>(triangle, accum);
+        odd_even_paths[i] = fold_with<OddEvenRow, OddEvenTop>(triangle, accum);
+    }
+}
+
+// These are constant expressions, so the tables are ready before any
+// static initializer could call `fold_kernels()`. Levels without a top
+// kernel of their own fold the top rows with their row kernel.
+template <RowKernel MaxRow, RowKernel OddEvenRow,
+          TopKernel MaxTop = fold_top<MaxRow>,
+          TopKernel OddEvenTop = fold_top<OddEvenRow>>
+constexpr FoldKernels make_kernels(IsaLevel level)
+{
+    return FoldKernels {
+        level, MaxRow, OddEvenRow,
+        fold_triangle_with<MaxRow, MaxTop>,
+        fold_triangle_with<OddEvenRow, OddEvenTop>,
+        solve_batch_with<MaxRow, MaxTop, OddEvenRow, OddEvenTop>
+    };
+}
+
+constexpr FoldKernels scalar_kernels =
+    make_kernels<max_path_row_scalar, odd_even_path_row_scalar>(IsaLevel::Scalar);
+
+#ifdef EULER67_DISPATCH_X86
+constexpr FoldKernels sse42_kernels =
+    make_kernels<max_path_row_sse42, odd_even_path_row_sse42>(IsaLevel::Sse42);
+constexpr FoldKernels avx2_kernels =
+    make_kernels<max_path_row_avx2, odd_even_path_row_avx2>(IsaLevel::Avx2);
+constexpr FoldKernels avx512_kernels =
+    make_kernels<max_path_row_avx512, odd_even_path_row_avx512,
+                 max_path_top_avx512, odd_even_path_top_avx512>(IsaLevel::Avx512);
+#endif
+
+
+bool parse_isa_name(std::string const& name, IsaLevel& level)
+{
+    for (IsaLevel candidate: { IsaLevel::Scalar, IsaLevel::Sse42,
+                               IsaLevel::Avx2, IsaLevel::Avx512 })
+    {
+        if (name == isa_name(candidate))
+        {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+IsaLevel select_level()
+{
+    IsaLevel const detected = detected_isa_level();
+
+    char const* forced = std::getenv("EULER67_ISA");
+    if (!forced || !*forced)
+        return detected;
+
+    IsaLevel level;
+    if (!parse_isa_name(forced, level))
+    {
+        std::cerr << "euler67: ignoring unknown EULER67_ISA=" << forced
+                  << std::endl;
+        return detected;
+    }
+    if (level > detected)
+    {
+        std::cerr << "euler67: this CPU does not support " << forced
+                  << ", using " << isa_name(detected) << std::endl;
+        return detected;
+    }
+    return level;
+}
+
+} // namespace
+
+
+char const* isa_name(IsaLevel level)
+{
+    switch (level)
+    {
+    case IsaLevel::Scalar: return "scalar";
+    case IsaLevel::Sse42:  return "sse4.2";
+    case IsaLevel::Avx2:   return "avx2";
+    case IsaLevel::Avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+IsaLevel detected_isa_level()
+{
+#ifdef EULER67_DISPATCH_X86
+    // __builtin_cpu_supports also checks that the OS saves the wider
+    // registers, so a level it reports is safe to use.
+    if (__builtin_cpu_supports("avx512f"))
+        return IsaLevel::Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return IsaLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return IsaLevel::Sse42;
+#endif
+    return IsaLevel::Scalar;
+}
+
+FoldKernels const& fold_kernels(IsaLevel level)
+{
+    switch (level)
+    {
+#ifdef EULER67_DISPATCH_X86
+    case IsaLevel::Avx512: return avx512_kernels;
+    case IsaLevel::Avx2:   return avx2_kernels;
+    case IsaLevel::Sse42:  return sse42_kernels;
+#endif
+    default:               return scalar_kernels;
+    }
+}
+
+FoldKernels const& fold_kernels()
+{
+    static FoldKernels const& kernels = fold_kernels(select_level());
+    return kernels;
+}
+
+int max_path_simd(Triangle const& triangle)
+{
+    return fold_kernels().max_path(triangle);
+}
+
+int max_odd_even_path_simd(Triangle const& triangle)
+{
+    return fold_kernels().odd_even_path(triangle);
+}
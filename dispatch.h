@@ -0,0 +1,94 @@
+/******************************************************
+ *
+ *  Chooses the fastest fold kernels the CPU supports,
+ *  once, when the program starts.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_DISPATCH_H
+#define EULER67_DISPATCH_H
+
+#include "triangle.h"
+
+
+/* The instruction set levels we have kernels for, in increasing order.
+ */
+enum class IsaLevel {
+    Scalar,
+    Sse42,
+    Avx2,
+    Avx512,
+};
+
+char const* isa_name(IsaLevel level);
+
+
+/* A set of fold kernels, all compiled for one IsaLevel.
+ *
+ * `max_path_row` and `odd_even_path_row` perform one step of the fold (see
+ * `fold_row`) with the rules of `max_path` and `max_odd_even_path`: they
+ * fold the `size` values of a row into `accum`, which holds `size + 1`
+ * results of the row below.
+ *
+ * `max_path` and `odd_even_path` are the whole folds, which may treat the
+ * short rows at the top differently (the AVX-512 ones keep them in a
+ * register).
+ *
+ * `solve_batch` solves `count` whole triangles, writing both answers for
+ * `triangles[i]` to `max_paths[i]` and `odd_even_paths[i]`. Its loops call
+ * the kernels of the same level directly rather than through a
+ * pointer.
+ */
+struct FoldKernels {
+    IsaLevel level;
+
+    void (*max_path_row)(int* accum, int const* values, size_t size);
+    void (*odd_even_path_row)(int* accum, int const* values, size_t size);
+
+    int (*max_path)(Triangle const& triangle);
+    int (*odd_even_path)(Triangle const& triangle);
+
+    void (*solve_batch)(Triangle const* const* triangles, size_t count,
+                        int* max_paths, int* odd_even_paths);
+};
+
+/* The kernels for the best level this CPU supports. They are chosen the
+ * first time this is called and never change, so callers can fetch them
+ * once, outside their loops, and call through the pointers without any
+ * further feature checks.
+ *
+ * For testing, the environment variable EULER67_ISA (one of "scalar",
+ * "sse4.2", "avx2" or "avx512") forces a lower level. A level the CPU does
+ * not support is lowered to the best one it does, with a warning.
+ */
+FoldKernels const& fold_kernels();
+
+/* The level of `fold_kernels()`. The other SIMD code (packed_triangle.cpp,
+ * overflow.cpp and adaptive.cpp) uses this too, so the override applies to
+ * every kernel in the program.
+ */
+inline IsaLevel isa_level()
+{
+    return fold_kernels().level;
+}
+
+/* The kernels for a specific level, which the caller must have checked
+ * the CPU supports. Mainly for benchmarks that compare levels.
+ */
+FoldKernels const& fold_kernels(IsaLevel level);
+
+/* The best level this CPU supports, ignoring EULER67_ISA.
+ */
+IsaLevel detected_isa_level();
+
+
+/* The same results as `max_path` and `max_odd_even_path`, folded with the
+ * kernels of `fold_kernels()`.
+ */
+int max_path_simd(Triangle const& triangle);
+int max_odd_even_path_simd(Triangle const& triangle);
+
+#endif // EULER67_DISPATCH_H
@@ -10,328 +10,662 @@
 */
 
 
-#include <vector>
-
+#include "triangle.h"
+#include "fixed_triangle.h"
+#include "server.h"
+#include "cache.h"
+#include "instrument.h"
+#include "triangle_file.h"
+#include "loader.h"
+#include "decompress.h"
+#include "sharded.h"
+#include "banded_fold.h"
+#include "maxplus.h"
+#include "dispatch.h"
+#include "mapped_triangle.h"
+#include "numa_fold.h"
+
+#include <cstdlib>        // std::atoi, std::atof
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
-#include <functional>     // std::function
 
-#include <stdexcept>      // std::argument_error
+/* The file containing the triangle located at
+ *   https://projecteuler.net/project/resources/p067_triangle.txt
+ */
+char const* filepath = "p067_triangle.txt";
+
+
+/* The example triangle from the problem description. Its answer is
+ * checked when the program is compiled, not when it runs.
+ */
+constexpr int example_cells[] = { 3,
+                                  7, 4,
+                                  2, 4, 6,
+                                  8, 5, 9, 3 };
 
+constexpr FixedTriangle<4> example_triangle {example_cells};
 
+static_assert(max_path(example_triangle) == 23,
+              "the maximum path of the example triangle is 3 + 7 + 4 + 9");
 
-/* A Triangle consists of multiple rows of ints where the first row
- * contains one element and each other row has precisely one more element
- * than the row preceeding it. An example Triangle can be depicted like this:
- *
- *     3
- *    7 4     (taken from the description of Project Euler Problem 67)
- *   2 4 6
- *  8 5 9 3
- *
- * It is important that the row-length property is not violated because each
- * number in the Triangle is considered adjacent to the two below it.
- * Ensuring correctness is much simpler if we can guarantee this property
- * statically.
+
+int usage()
+{
+    std::cerr
+        << "usage: euler67 [--cache CACHE_FILE] [--profile table|json]"
+           " [--counters] [FILE...]\n"
+        << "       euler67 --batch [--loader uring|threads] FILE...\n"
+        << "       euler67 --sharded [--workers N] [--shard-size N] FILE...\n"
+        << "       euler67 --banded BANDS [FILE]\n"
+        << "       euler67 --maxplus THREADS [FILE]\n"
+        << "       euler67 --numa THREADS [--interleave] [FILE]\n"
+        << "       euler67 --convert TEXT_FILE BINARY_FILE\n"
+        << "       euler67 --out-of-core [--direct] [--checkpoint PREFIX]"
+           " [--checkpoint-every SECONDS] BINARY_FILE\n"
+        << "       euler67 --mapped [--populate] [--readahead BYTES]"
+           " [--prefetch ROWS] BINARY_FILE\n"
+        << "       euler67 --serve SOCKET [FILE...]\n"
+        << "       euler67 --query SOCKET SPEC...\n";
+    return 2;
+}
+
+
+/* Solve the triangle in `path`, consulting `cache` first.
  *
- * This class only allows you to construct Triangles that satisfy this
- * property. You can create Triangles by:
- *   - Constructing an empty Triangle with the default constructor
- *   - Copying, moving, or assigning (from an existing correct Triangle)
- *   - Adding rows to a Triangle one at a time. If the user tries to add
- *     a row with the wrong number of elements, the Triangle is not modified
- *     and std::invalid_argument exception is thrown.
+ * The file is hashed a block at a time as it is read into memory, while
+ * each block is still in the cache. On a cache hit the text is never
+ * tokenized and the triangle is never folded. Compressed files are cached
+ * by the hash of their compressed contents, and on a miss they are
+ * decompressed on the fly as they are parsed.
  */
-class Triangle {
-public:
-    using Row = std::vector<int>;
+SolvedTriangle solve_file(char const* path, ResultCache& cache, bool& cached)
+{
+    std::ifstream file;
+    {
+        EULER67_PHASE("open");
+        file.open(path, std::ios::binary);
+    }
+    if (!file.is_open())
+        throw std::runtime_error(std::string("Failed to open ") + path);
 
-private:
-    /*  Class Invariant:    rows_[i].length = i + 1;  */
+    std::string text;
+    ContentKey key;
+    {
+        EULER67_PHASE("read");
+        ContentHash hash;
+        char block[1 << 16];
+        while (file.read(block, sizeof block) || file.gcount() != 0)
+        {
+            size_t const got = static_cast<size_t>(file.gcount());
+            hash.update(block, got);
+            text.append(block, got);
+        }
+        key = hash.finish();
+    }
 
-    std::vector<Row> rows_;
+    cached = true;
+    if (SolvedTriangle const* hit = cache.lookup(key))
+        return *hit;
+    cached = false;
 
-public:
-    /* Access the rows of the `Triangle`. This provides a const reference
-     * because the user cannot be permitted to change the length of the rows.
-     */
-    std::vector<Row> const& rows() const
+    Triangle triangle;
     {
-        return rows_;
+        EULER67_PHASE("parse_triangle");
+        triangle = parse_triangle_file_contents(text);
     }
 
-    /* `Triangle::at(r,n)` returns the n'th value of the r'th row.
-     *
-     *  The non-const version of this function is the only way for the user
-     *  to modify the contents of the Triangle. If the user does not satisfy
-     *  the preconditions the result is undefined.
-     *
-     *  Preconditions:
-     *
-     *      r < triangle.height()
-     *      n <= r + 1
-     */
-    int  at(size_t row, size_t n) const { return rows_[row][n]; }
-    int& at(size_t row, size_t n)       { return rows_[row][n]; }
-
-
-    /* The height of a Triangle is the number of rows.
-     */
-    Row::size_type height() const
+    SolvedTriangle solved;
+    solved.height = triangle.height();
     {
-        return rows_.size();
+        EULER67_PHASE("max_path");
+        solved.max_path = max_path_simd(triangle);
     }
-
-    /* The width is the size of the bottom-most row. This is equal to the
-     * height, but is defined seperately to improve clarity.
-     */
-    size_t width() const
     {
-        return height();
+        EULER67_PHASE("max_odd_even_path");
+        solved.max_odd_even_path = max_odd_even_path_simd(triangle);
     }
 
-    /* Add a row to the tree. It must have a size equal to the new height of
-     * the tree (the current height plus one).
-     */
-    void append_row(Row&& row)
+    cache.insert(key, solved);
+    return solved;
+}
+
+struct SolveOptions {
+    char const* cache_path = nullptr;
+    bool profile = false;
+    bool counters = false;
+    ProfileFormat profile_format = ProfileFormat::Table;
+};
+
+/* `euler67 [--cache CACHE_FILE] [--profile table|json] [--counters] [FILE...]`
+ *
+ * Print the answers to Problem 67 (and my odd/even variant) for each
+ * triangle file, by default the one in `filepath`. With `--cache`, results
+ * are remembered between runs in CACHE_FILE. With `--profile`, the time
+ * spent in each phase is printed to stderr (this needs a build with
+ * `make INSTRUMENT=1`), and `--counters` adds hardware counters.
+ */
+int solve(std::vector<char const*> paths, SolveOptions const& options)
+{
+    char const* cache_path = options.cache_path;
+
+    if (options.profile)
     {
-        if (row.size() != this->height() + 1)
+        if (!instrumentation_available())
         {
-            throw std::invalid_argument(
-                "Triangle::append_row requires that input row has a size equal"
-                " to the height of the triangle plus one");
+            std::cerr << "euler67: --profile needs a build with "
+                         "`make INSTRUMENT=1`" << std::endl;
+            return 2;
         }
+        enable_profiling(options.counters);
+    }
+
+    if (paths.empty())
+        paths.push_back(filepath);
+
+    ResultCache cache;
+    if (cache_path)
+        cache.load(cache_path);
+
+    for (char const* path: paths)
+    {
+        bool cached;
+        SolvedTriangle const solved = solve_file(path, cache, cached);
+
+        std::cout
+            << "Loaded triangle with "
+            << solved.height << " rows"
+            << (cached ? " (cached)" : "") << ". " << std::endl
 
-        rows_.emplace_back(std::move(row));
+            << "The maximum path value is "
+            << solved.max_path << "." << std::endl
+
+            << "If you may only move left onto an odd number or right onto an"
+                " even number, the\nmaximum path value is "
+            << solved.max_odd_even_path << "." << std::endl;
     }
 
-    /*  Note: we depend on the default constructors here and let
-     *  std::vector do all the work of memory management.
-     *
-     *  This class is solely responsible for maintaining the
-     *  row-length invariant.
-     */
-};
+    if (cache_path)
+        cache.save(cache_path);
 
+    print_profile(std::cerr, options.profile_format);
+    return 0;
+}
 
-/* fold_triangle<T>(tri, make_t, combine_t)
- *     - reduces the entire triangle to a single value of type T
- *       by traversing each row from the bottom up
- *     - uses `make_t` to produce a T from every value in the bottom row
- *     - uses `combine_t` to aggregate each number with the two T's below it.
- *     - does not modify the original triangle
- *
- * First a `T` is produced from every `int` in the bottom row of the triangle 
- * using the function `make_t`.
- *
- *     3
- *    7 4       ==>    ts = { make_t(2), make_t(4), make_t(6) }
- *   2 4 6 <-
- *
- *
- * Then, `combine_t` is used to combine each `int` in the next-highest row
- * with the two `T`s that were just produced in the corresponding positions
- * in the row below it. 
- *
- *     3
- *    7 4  <-   ==>    ts' = { combine_t(7, ts[0], ts[1]),
- *   2 4 6                     combine_t(4, ts[1], ts[2])
- *
- *
- * This is applied iteratively to each row until only the top row remains,
- * with a single value of `T`.
+/* `euler67 --serve SOCKET [FILE...]`
  *
- *     3   <-
- *    7 4       ==>    ts'' = { combine_t(3, ts'[0], ts'[1]) }
- *   2 4 6                      
+ * Load every triangle once and answer queries until interrupted. Triangles
+ * are numbered in the order they are given on the command line.
+ */
+int serve(std::string const& socket_path, std::vector<char const*> paths)
+{
+    if (paths.empty())
+        paths.push_back(filepath);
+
+    std::vector<Triangle> triangles;
+    for (char const* path: paths)
+    {
+        std::ifstream file {path};
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << path << std::endl;
+            return 1;
+        }
+        triangles.push_back(parse_triangle(file));
+    }
+
+    std::cerr << "Serving " << triangles.size() << " triangle(s) on "
+              << socket_path << std::endl;
+    run_server(socket_path, std::move(triangles));
+    return 0;
+}
+
+/* `euler67 --query SOCKET SPEC...`
  *
+ * Send each query to a running server. See `parse_query_spec` for the
+ * format of SPEC.
  */
-template <typename T>
-T fold_triangle(Triangle const& triangle,
-       std::function<T(int)> make_t,
-       std::function<T(int,T,T)> combine_t)
+int query(std::string const& socket_path, std::vector<char const*> specs)
 {
-    if (triangle.height() == 0) {
-        throw std::invalid_argument(
-            "fold_triangle expects a non-empty triangle");
+    std::vector<Query> queries;
+    for (char const* spec: specs)
+    {
+        Query q = parse_query_spec(spec);
+        q.id = static_cast<std::uint32_t>(queries.size());
+        queries.push_back(q);
     }
 
-    /* We're going to use this vector to compute the values of each row.
-     * With each row iteration, the values of `accum` will be overwritten.
-     *
-     * This is a vector instead of an array because in general we won't
-     * know the size of the Triangle until runtime.
-     */
-    std::vector<T> accum;
-    accum.reserve(triangle.width());
+    return run_client(socket_path, queries, std::cout) ? 0 : 1;
+}
+
+/* `euler67 --batch [--loader uring|threads] FILE...`
+ *
+ * Solve many triangle files, reading them asynchronously so that the
+ * reads of some files overlap with parsing and folding the others. One
+ * line is printed per file, in the order the files were given.
+ */
+int solve_batch(std::vector<char const*> args)
+{
+    LoaderOptions options;
+    if (args.size() >= 2 && std::string(args.front()) == "--loader")
+    {
+        std::string const backend = args[1];
+        if (backend == "uring")
+            options.backend = LoaderBackend::IoUring;
+        else if (backend == "threads")
+            options.backend = LoaderBackend::ThreadPool;
+        else
+            return usage();
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if (args.empty())
+        return usage();
+
+    std::vector<std::string> const paths(args.begin(), args.end());
+    std::vector<std::string> lines(paths.size());
+    bool ok = true;
+
+    load_files(paths, [&](LoadedFile&& file) {
+        std::ostringstream line;
+        line << paths[file.index] << ": ";
+
+        try {
+            if (!file.error.empty())
+                throw std::runtime_error(file.error);
+
+            Triangle const triangle =
+                parse_triangle_file_contents(file.contents);
+
+            // Solve before formatting, so that a failure is reported on
+            // its own rather than after part of the answer.
+            int const max = max_path_simd(triangle);
+            int const odd_even = max_odd_even_path_simd(triangle);
+            line << triangle.height() << " rows, max path " << max
+                 << ", odd/even path " << odd_even;
+        }
+        catch (std::exception const& e) {
+            line << "error: " << e.what();
+            ok = false;
+        }
 
-    // We're going to traverse the rows in reverse order.
-    // Note: these are const_iterators because rows() returns a const vector
-    auto row_iter = triangle.rows().rbegin();
-    auto row_end  = triangle.rows().rend();
+        lines[file.index] = line.str();
+    }, options);
 
+    for (auto const& line: lines)
+        std::cout << line << "\n";
+    return ok ? 0 : 1;
+}
 
-    // First we fill `accum` with the results of mapping the function
-    // `make_t` over the values of the bottom row.
-    for (int value: *row_iter)
+/* `euler67 --sharded [--workers N] [--shard-size N] FILE...`
+ *
+ * Solve many triangle files with a pool of worker processes (see
+ * sharded.h). The files are read and parsed here, and the folds run in the
+ * workers. Output is the same as `--batch`.
+ */
+int solve_sharded_batch(std::vector<char const*> args)
+{
+    ShardedOptions options;
+    while (args.size() >= 2)
     {
-        accum.emplace_back(make_t(value));
+        std::string const option = args.front();
+        if (option == "--workers")
+            options.workers = static_cast<unsigned>(std::atoi(args[1]));
+        else if (option == "--shard-size")
+            options.shard_size = static_cast<unsigned>(std::atoi(args[1]));
+        else
+            break;
+        args.erase(args.begin(), args.begin() + 2);
     }
+    if (args.empty() || options.workers == 0 || options.shard_size == 0)
+        return usage();
 
-    // Traverse all the rows from the bottom up
-    while(++row_iter != row_end)
+    std::vector<std::string> const paths(args.begin(), args.end());
+    std::vector<std::string> lines(paths.size());
+    bool ok = true;
+
+    // The triangles that parsed, and the file each one came from.
+    std::vector<Triangle> triangles;
+    std::vector<size_t> sources;
+
+    load_files(paths, [&](LoadedFile&& file) {
+        try {
+            if (!file.error.empty())
+                throw std::runtime_error(file.error);
+
+            triangles.push_back(parse_triangle_file_contents(file.contents));
+            sources.push_back(file.index);
+        }
+        catch (std::exception const& e) {
+            lines[file.index] = paths[file.index] + ": error: " + e.what();
+            ok = false;
+        }
+    });
+
+    std::vector<ShardedResult> const results =
+        solve_sharded(triangles, options);
+
+    for (size_t i = 0; i != results.size(); ++i)
     {
-        // For each row...
-
-        // Start at the beginning of the list of T's
-        auto accum_iter = accum.begin();
-
-        /* For each value `n` in the row,
-         * apply the user-provided function `combine_t` to `n` and
-         * the two below-and-adjacent T's that were previously computed.
-         *
-         * The bidirectional iterator `accum_iter` is used to read the
-         * value from the accumulator and then overwrite it with a new value.
-         */
-        for (size_t i = 0; i != row_iter->size(); ++i)
+        std::ostringstream line;
+        line << paths[sources[i]] << ": ";
+
+        ShardedResult const& result = results[i];
+        if (result.error.empty())
+        {
+            line << result.solved.height << " rows, max path "
+                 << result.solved.max_path << ", odd/even path "
+                 << result.solved.max_odd_even_path;
+        }
+        else
         {
-            int value = (*row_iter)[i];
-            *accum_iter =
-                combine_t(value, *accum_iter, *std::next(accum_iter));
-            ++accum_iter;
+            line << "error: " << result.error;
+            ok = false;
         }
 
-        /* Note:
-         *   At this point we could erase the remaining values which were not
-         *   overwritten like this:
-         *   
-         *       accum.erase(accum_iter, accum.end());
-         *
-         *   However, there is no harm in leaving them there so long as we
-         *   don't access them again.
-         */
+        lines[sources[i]] = line.str();
     }
 
-    // All the rows have been processed, and the final reduction is at the
-    // front of `accum`.
-    return accum.front();
+    for (auto const& line: lines)
+        std::cout << line << "\n";
+    return ok ? 0 : 1;
 }
 
-/* This function uses `fold_triangle<int>` to compute the solution to
- * Project Euler Number 67.
- *
- * It works by starting at the bottom row and working upwards, eliminating
- * the lesser of adjacent paths until it reaching the top.
+/* Read and parse a whole triangle file, which may be compressed.
+ */
+Triangle read_triangle_file(char const* path)
+{
+    std::ifstream file {path, std::ios::binary};
+    if (!file.is_open())
+        throw std::runtime_error(std::string("Failed to open ") + path);
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return parse_triangle_file_contents(contents.str());
+}
+
+/* `euler67 --banded BANDS [FILE]`
  *
- * Note that by using the `fold_triangle` to handle the traversal, this
- * function has been distilled down to its basic components.
+ * Solve one triangle with the fold split into BANDS bands of rows, each
+ * folded by its own worker (see banded_fold.h). The workers are threads
+ * connected by a loopback transport.
  */
-int max_path(Triangle const& triangle)
+int solve_banded(std::vector<char const*> args)
 {
-    // For the bottom row, the result of each number is simply that number.
-    auto leaf = [](int i) -> int { return i; };
+    if (args.empty() || args.size() > 2)
+        return usage();
 
-    // For every other row, the result of each number is that number plus the
-    // greater of the two results immediately under it.
-    auto combine = [](int i, int left, int right) -> int {
-        return i + std::max(left, right);
-    };
+    int const bands = std::atoi(args[0]);
+    if (bands <= 0)
+        return usage();
+
+    Triangle const triangle =
+        read_triangle_file(args.size() == 2 ? args[1] : filepath);
 
-    return fold_triangle<int>(triangle, leaf, combine);
+    auto leaf = [](int i) -> int { return i; };
+    unsigned const n = static_cast<unsigned>(bands);
+
+    std::cout
+        << "The maximum path value is "
+        << fold_triangle_banded<int>(triangle, n, leaf, max_path_combine)
+        << "." << std::endl
+
+        << "If you may only move left onto an odd number or right onto an"
+            " even number, the\nmaximum path value is "
+        << fold_triangle_banded<int>(triangle, n, leaf, odd_even_path_combine)
+        << "." << std::endl;
+    return 0;
 }
 
-/* For fun, I added more rules to the problem.
- * As before, we must find the path of maximum value. However, we add the rule
- * that the path may only turn left onto an odd number, and may only go right
- * onto an even number.
+/* `euler67 --maxplus THREADS [FILE]`
  *
- * If the path reaches a point where it cannot continue, it has reached
- * the maximum value of that path.
- *
- * The change is relatively small, because fold_triangle<T> does all the
- * work in traversing the triangle and combining adjacent values.
+ * Solve one triangle by composing the max-plus operators of its row bands
+ * in parallel (see maxplus.h). Only the maximum path is printed, since the
+ * odd/even rule has no max-plus form.
  */
-int max_odd_even_path(Triangle const& triangle)
+int solve_maxplus(std::vector<char const*> args)
 {
-    auto leaf = [](int i) -> int { return i; };
+    if (args.empty() || args.size() > 2)
+        return usage();
 
-    auto is_even = [](int n) -> bool { return n % 2 == 0; };
+    int const threads = std::atoi(args[0]);
+    if (threads <= 0)
+        return usage();
 
-    auto combine = [is_even](int i, int left, int right) -> int {
-        return i +
-            std::max(is_even(left) ? 0 : left,
-                     is_even(right) ? right : 0);
-    };
+    Triangle const triangle =
+        read_triangle_file(args.size() == 2 ? args[1] : filepath);
 
-    return fold_triangle<int>(triangle, leaf, combine);
+    std::cout
+        << "The maximum path value is "
+        << max_path_maxplus(triangle, static_cast<unsigned>(threads))
+        << "." << std::endl;
+    return 0;
 }
 
-
-// Parse a file containing a Triangle in the format provided by
-// Project Euler Problem 67.
-Triangle parse_triangle(std::ifstream& stream)
+/* `euler67 --numa THREADS [--interleave] [FILE]`
+ *
+ * Solve one triangle with its columns split among THREADS threads, each
+ * pinned to a NUMA node and holding its columns in that node's memory
+ * (see numa_fold.h). `--interleave` spreads the memory over every node
+ * instead, for comparison.
+ */
+int solve_numa(std::vector<char const*> args)
 {
-    Triangle triangle;
-    std::string row_string;
+    if (args.empty())
+        return usage();
 
-    Triangle::Row::size_type expected_row_size = 0;
+    int const threads = std::atoi(args[0]);
+    args.erase(args.begin());
+    if (threads <= 0)
+        return usage();
 
-    // Each line corresponds to a row
-    while (std::getline(stream, row_string))
+    NumaOptions options;
+    options.threads = static_cast<unsigned>(threads);
+    if (!args.empty() && std::string(args.front()) == "--interleave")
     {
-        ++expected_row_size;
+        options.placement = Placement::Interleaved;
+        args.erase(args.begin());
+    }
+    if (args.size() > 1)
+        return usage();
 
-        // Triangle::Row is an alias for std::vector<int>
-        Triangle::Row row;
-        row.reserve(expected_row_size);
+    NumaTriangle const triangle {
+        read_triangle_file(args.empty() ? filepath : args.front()), options
+    };
 
-        int value;
-        std::istringstream row_stream {row_string};
+    std::cout
+        << "The maximum path value is " << max_path(triangle) << "." << std::endl
 
-        // Each row contains values seperated by whitespace
-        while (row_stream >> value)
-        {
-            row.push_back(value);
-        }
+        << "If you may only move left onto an odd number or right onto an"
+            " even number, the\nmaximum path value is "
+        << max_odd_even_path(triangle) << "." << std::endl;
+    return 0;
+}
 
-        // C++11 helps us avoid copying the entire row
-        triangle.append_row(std::move(row));
+/* `euler67 --convert TEXT_FILE BINARY_FILE`
+ *
+ * Convert a triangle to the binary format read by `--out-of-core`. The
+ * conversion streams one row at a time, so it works on any size of file.
+ */
+int convert(char const* text_path, char const* binary_path)
+{
+    std::ifstream text {text_path};
+    if (!text.is_open()) {
+        std::cerr << "Failed to open " << text_path << std::endl;
+        return 1;
+    }
+    std::ofstream binary {binary_path, std::ios::binary | std::ios::trunc};
+    if (!binary.is_open()) {
+        std::cerr << "Failed to create " << binary_path << std::endl;
+        return 1;
     }
 
-    // Hopefully return value optimization will kick in here and avoid
-    // copying the entire Triangle.
-    return triangle;
+    std::uint64_t height = convert_text_to_binary(text, binary);
+    std::cout << "Wrote triangle with " << height << " rows to "
+              << binary_path << "." << std::endl;
+    return 0;
 }
 
-
-/* The file containing the triangle located at
- *   https://projecteuler.net/project/resources/p067_triangle.txt
+/* `euler67 --out-of-core [--direct] [--checkpoint PREFIX]
+ *                        [--checkpoint-every SECONDS] BINARY_FILE`
+ *
+ * Solve a triangle in the binary format without loading it into memory.
+ * Each fold reads the file backwards one row at a time.
+ *
+ * With `--checkpoint`, each fold saves its progress (by default every
+ * minute) to PREFIX.max or PREFIX.oddeven, and a rerun after a crash picks
+ * up from there instead of from the bottom row.
  */
-char const* filepath = "p067_triangle.txt";
-
-
-int main()
+int solve_out_of_core(std::vector<char const*> args)
 {
-    std::ifstream file {filepath};
-    if (!file.is_open()) {
-        std::cerr << "Failed to open " << filepath << std::endl;
-        return 1;
+    OutOfCoreOptions options;
+    std::string checkpoint_prefix;
+    while (!args.empty() && args.front()[0] == '-')
+    {
+        std::string const option = args.front();
+        bool const has_value = args.size() >= 2;
+
+        if (option == "--direct")
+            options.direct_io = true;
+        else if (option == "--checkpoint" && has_value)
+            checkpoint_prefix = args[1];
+        else if (option == "--checkpoint-every" && has_value)
+            options.checkpoint_seconds = std::atof(args[1]);
+        else
+            return usage();
+        args.erase(args.begin(), args.begin() + (option == "--direct" ? 1 : 2));
     }
+    if (args.size() != 1)
+        return usage();
 
-    Triangle const triangle = parse_triangle(file);
+    std::string const path = args.front();
+    auto leaf = [](int i) -> int { return i; };
 
+    OutOfCoreOptions max_options = options;
+    OutOfCoreOptions odd_even_options = options;
+    if (!checkpoint_prefix.empty())
+    {
+        max_options.checkpoint_path = checkpoint_prefix + ".max";
+        odd_even_options.checkpoint_path = checkpoint_prefix + ".oddeven";
+    }
+
+    int const max = fold_triangle_file<int>(path, leaf, max_path_combine,
+                                            max_options);
+    int const odd_even = fold_triangle_file<int>(path, leaf,
+                                                 odd_even_path_combine,
+                                                 odd_even_options);
     std::cout
-        << "Loaded triangle with "
-        << triangle.height() << " rows. " << std::endl
+        << "The maximum path value is " << max << "." << std::endl
 
-        << "The maximum path value is "
-        << max_path(triangle) << "." << std::endl
+        << "If you may only move left onto an odd number or right onto an"
+            " even number, the\nmaximum path value is "
+        << odd_even << "." << std::endl;
+    return 0;
+}
+
+/* `euler67 --mapped [--populate] [--readahead BYTES] [--prefetch ROWS]
+ *                   BINARY_FILE`
+ *
+ * Solve a triangle in the binary format by mapping the file into memory
+ * instead of reading it. With `--populate` the whole file is read in when
+ * it is mapped; otherwise each fold asks for BYTES (by default 8MiB) of
+ * the file ahead of the row it is on. `--prefetch` sets how many rows
+ * ahead of itself the fold prefetches into the cache.
+ */
+int solve_mapped(std::vector<char const*> args)
+{
+    MappedTriangleOptions options;
+    while (!args.empty() && args.front()[0] == '-')
+    {
+        std::string const option = args.front();
+        bool const has_value = args.size() >= 2;
+
+        if (option == "--populate")
+            options.populate = true;
+        else if (option == "--readahead" && has_value)
+            options.readahead_bytes = static_cast<size_t>(std::atof(args[1]));
+        else if (option == "--prefetch" && has_value)
+            options.prefetch_rows = static_cast<size_t>(std::atoi(args[1]));
+        else
+            return usage();
+        args.erase(args.begin(), args.begin() + (option == "--populate" ? 1 : 2));
+    }
+    if (args.size() != 1)
+        return usage();
+
+    MappedTriangle const triangle {args.front(), options};
+    std::cout
+        << "The maximum path value is " << max_path(triangle) << "." << std::endl
 
-        << "If you may only move left onto an odd number or right onto an even"
-            " number, the\nmaximum path value is "
+        << "If you may only move left onto an odd number or right onto an"
+            " even number, the\nmaximum path value is "
         << max_odd_even_path(triangle) << "." << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::string const mode = argc > 1 ? argv[1] : "";
+    std::vector<char const*> rest(argv + std::min(argc, 3), argv + argc);
+
+    try {
+        if (mode == "--serve" && argc >= 3)
+            return serve(argv[2], rest);
+        if (mode == "--query" && argc >= 4)
+            return query(argv[2], rest);
+        if (mode == "--batch")
+            return solve_batch(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--sharded")
+            return solve_sharded_batch(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--banded")
+            return solve_banded(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--maxplus")
+            return solve_maxplus(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--numa")
+            return solve_numa(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--convert" && argc == 4)
+            return convert(argv[2], argv[3]);
+        if (mode == "--out-of-core")
+            return solve_out_of_core(
+                std::vector<char const*>(argv + 2, argv + argc));
+        if (mode == "--mapped")
+            return solve_mapped(
+                std::vector<char const*>(argv + 2, argv + argc));
+
+        SolveOptions options;
+        int i = 1;
+        for (; i < argc && argv[i][0] == '-'; ++i)
+        {
+            std::string const option = argv[i];
+            bool const has_value = i + 1 < argc;
+
+            if (option == "--cache" && has_value)
+                options.cache_path = argv[++i];
+            else if (option == "--profile" && has_value)
+            {
+                std::string const format = argv[++i];
+                if (format == "json")
+                    options.profile_format = ProfileFormat::Json;
+                else if (format != "table")
+                    return usage();
+                options.profile = true;
+            }
+            else if (option == "--counters")
+                options.counters = true;
+            else
+                return usage();
+        }
+
+        return solve(std::vector<char const*>(argv + i, argv + argc), options);
+    }
+    catch (std::exception const& e) {
+        std::cerr << "euler67: " << e.what() << std::endl;
+        return 1;
+    }
 }
 
 /*  That's it!
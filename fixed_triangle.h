@@ -0,0 +1,165 @@
+/******************************************************
+ *
+ *  A fixed-capacity Triangle that can be built and
+ *  solved at compile time.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_FIXED_TRIANGLE_H
+#define EULER67_FIXED_TRIANGLE_H
+
+#include "triangle.h"
+
+#include <cstddef>
+#include <stdexcept>
+
+
+/* A FixedTriangle<MaxHeight> is a Triangle of at most `MaxHeight` rows whose
+ * values live inline in the object instead of on the heap. Every member is
+ * constexpr, so a triangle that is fixed configuration can be embedded in
+ * the program and solved by the compiler:
+ *
+ *     constexpr int cells[] = { 3,
+ *                               7, 4,
+ *                               2, 4, 6,
+ *                               8, 5, 9, 3 };
+ *     constexpr FixedTriangle<4> example {cells};
+ *     static_assert(max_path(example) == 23, "");
+ *
+ * It keeps the same row-length invariant as Triangle: rows are appended one
+ * at a time and each must be one longer than the last. Breaking the
+ * invariant throws std::invalid_argument, which in a constant expression
+ * becomes a compile error.
+ */
+template <size_t MaxHeight>
+class FixedTriangle {
+public:
+    static constexpr size_t capacity = MaxHeight * (MaxHeight + 1) / 2;
+
+private:
+    /*  Class Invariant:  row r occupies cells_[r*(r+1)/2] to
+     *                    cells_[r*(r+1)/2 + r], for r < height_.  */
+
+    int cells_[capacity == 0 ? 1 : capacity];
+    size_t height_;
+
+    static constexpr size_t row_start(size_t row)
+    {
+        return row * (row + 1) / 2;
+    }
+
+public:
+    constexpr FixedTriangle()
+        : cells_{}, height_(0)
+    {
+    }
+
+    /* Build a triangle from all of its values, listed row by row from the
+     * top. The number of values must be a triangular number.
+     */
+    template <size_t N>
+    constexpr explicit FixedTriangle(int const (&values)[N])
+        : cells_{}, height_(0)
+    {
+        size_t used = 0;
+        while (used < N)
+        {
+            if (N - used < height_ + 1)
+            {
+                throw std::invalid_argument(
+                    "FixedTriangle requires a triangular number of values");
+            }
+            append_row(values + used, height_ + 1);
+            used += height_;
+        }
+    }
+
+    constexpr size_t height() const { return height_; }
+    constexpr size_t width() const { return height(); }
+
+    /* `at(r,n)` returns the n'th value of the r'th row, with the same
+     * preconditions as `Triangle::at`.
+     */
+    constexpr int  at(size_t row, size_t n) const { return cells_[row_start(row) + n]; }
+    constexpr int& at(size_t row, size_t n)       { return cells_[row_start(row) + n]; }
+
+    /* Pointer to the first value of a row, which has `row + 1` values.
+     */
+    constexpr int const* row(size_t r) const { return cells_ + row_start(r); }
+
+    /* Add a row of `size` values. It must have a size equal to the new
+     * height, and there must be room for it.
+     */
+    constexpr void append_row(int const* values, size_t size)
+    {
+        if (size != height_ + 1)
+        {
+            throw std::invalid_argument(
+                "FixedTriangle::append_row requires that input row has a size"
+                " equal to the height of the triangle plus one");
+        }
+        if (height_ == MaxHeight)
+        {
+            throw std::invalid_argument(
+                "FixedTriangle::append_row would exceed the capacity");
+        }
+
+        for (size_t i = 0; i != size; ++i)
+            cells_[row_start(height_) + i] = values[i];
+        ++height_;
+    }
+};
+
+
+/* fold_triangle<T>(fixed_triangle, make_t, combine_t)
+ *
+ * The same bottom-up fold as `fold_triangle<T>` on a Triangle, written so
+ * that it can run in a constant expression. `make_t` and `combine_t` are
+ * function objects (such as `LeafValue` and `MaxPathCombine`) rather than
+ * std::function, which cannot be used at compile time, and the accumulator
+ * is a fixed-size array on the stack instead of a std::vector.
+ */
+template <typename T, size_t MaxHeight, typename Make, typename Combine>
+constexpr T fold_triangle(FixedTriangle<MaxHeight> const& triangle,
+                          Make make_t, Combine combine_t)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle expects a non-empty triangle");
+    }
+
+    T accum[MaxHeight] {};
+
+    size_t const bottom = triangle.height() - 1;
+    for (size_t i = 0; i != triangle.width(); ++i)
+    {
+        accum[i] = make_t(triangle.at(bottom, i));
+    }
+
+    for (size_t r = bottom; r-- != 0; )
+    {
+        for (size_t i = 0; i != r + 1; ++i)
+        {
+            accum[i] = combine_t(triangle.at(r, i), accum[i], accum[i + 1]);
+        }
+    }
+
+    return accum[0];
+}
+
+template <size_t MaxHeight>
+constexpr int max_path(FixedTriangle<MaxHeight> const& triangle)
+{
+    return fold_triangle<int>(triangle, LeafValue(), MaxPathCombine());
+}
+
+template <size_t MaxHeight>
+constexpr int max_odd_even_path(FixedTriangle<MaxHeight> const& triangle)
+{
+    return fold_triangle<int>(triangle, LeafValue(), OddEvenPathCombine());
+}
+
+#endif // EULER67_FIXED_TRIANGLE_H
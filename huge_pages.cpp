@@ -0,0 +1,116 @@
+/******************************************************
+ *
+ *  Allocation backed by huge pages, for the values of
+ *  very large triangles.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "huge_pages.h"
+
+#include <cstdint>
+
+#include <sys/mman.h>
+
+// Older headers lack the flags that select the size of an explicit huge
+// page; the values are part of the kernel ABI.
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+
+namespace {
+
+size_t const huge_page = size_t(2) << 20;
+size_t const giant_page = size_t(1) << 30;
+
+/* The length actually mapped for `bytes`. It only depends on `bytes`, so
+ * `deallocate_pages` can work it out again, and it is a multiple of the
+ * page size of every way the memory may have been mapped.
+ */
+size_t mapped_length(size_t bytes)
+{
+    size_t const unit = bytes >= giant_page ? giant_page : huge_page;
+    return (bytes + unit - 1) / unit * unit;
+}
+
+void* map_explicit(size_t length)
+{
+    int const size_flag = length >= giant_page && length % giant_page == 0
+                        ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+
+    void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag,
+                     -1, 0);
+    if (p == MAP_FAILED && size_flag == MAP_HUGE_1GB)
+    {
+        // No 1GiB pages reserved; 2MiB ones will still do.
+        p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB,
+                   -1, 0);
+    }
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+/* Transparent huge pages can only back 2MiB-aligned ranges, and mmap only
+ * promises 4KiB alignment, so map an extra huge page and unmap the ends.
+ */
+void* map_transparent(size_t length)
+{
+    size_t const padded = length + huge_page;
+    void* p = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return nullptr;
+
+    std::uintptr_t const start = reinterpret_cast<std::uintptr_t>(p);
+    std::uintptr_t const aligned = (start + huge_page - 1) / huge_page * huge_page;
+    size_t const head = aligned - start;
+    size_t const tail = padded - head - length;
+
+    if (head)
+        ::munmap(p, head);
+    if (tail)
+        ::munmap(reinterpret_cast<char*>(aligned + length), tail);
+
+    // Only advice: without transparent huge pages this is a normal mapping.
+    ::madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+    return reinterpret_cast<void*>(aligned);
+}
+
+bool use_pages(size_t bytes, PageSize pages)
+{
+    return pages == PageSize::Huge && bytes >= huge_page;
+}
+
+} // namespace
+
+
+void* allocate_pages(size_t bytes, PageSize pages)
+{
+    if (!use_pages(bytes, pages))
+        return ::operator new(bytes);
+
+    size_t const length = mapped_length(bytes);
+    if (void* p = map_explicit(length))
+        return p;
+    if (void* p = map_transparent(length))
+        return p;
+    throw std::bad_alloc();
+}
+
+void deallocate_pages(void* p, size_t bytes, PageSize pages)
+{
+    if (!use_pages(bytes, pages))
+        ::operator delete(p);
+    else
+        ::munmap(p, mapped_length(bytes));
+}
@@ -0,0 +1,99 @@
+/******************************************************
+ *
+ *  Allocation backed by huge pages, for the values of
+ *  very large triangles.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_HUGE_PAGES_H
+#define EULER67_HUGE_PAGES_H
+
+#include <cstddef>
+#include <new>            // std::bad_alloc
+#include <type_traits>
+
+
+enum class PageSize {
+    Normal,
+    Huge,
+};
+
+/* A fold walks through every value of a triangle once, so a triangle of
+ * 1e5 rows (20GB of values) touches five million 4KiB pages, each needing
+ * its own TLB entry. Backing it with 2MiB pages cuts that by 512 times.
+ *
+ * `allocate_pages(bytes, PageSize::Huge)` tries, in order:
+ *
+ *   - explicit huge pages (MAP_HUGETLB), 1GiB ones for allocations of at
+ *     least 1GiB and 2MiB ones otherwise. These come from the pool reserved
+ *     in /proc/sys/vm/nr_hugepages, which is usually empty;
+ *   - an ordinary mapping aligned to 2MiB with madvise(MADV_HUGEPAGE), which
+ *     lets transparent huge pages back it when they are enabled in
+ *     "always" or "madvise" mode.
+ *
+ * Allocations smaller than 2MiB, and every PageSize::Normal allocation,
+ * come from operator new. Throws std::bad_alloc if the memory cannot be
+ * mapped. `deallocate_pages` must be given the same size and PageSize.
+ */
+void* allocate_pages(size_t bytes, PageSize pages);
+void deallocate_pages(void* p, size_t bytes, PageSize pages);
+
+
+/* A standard allocator that allocates with `allocate_pages`. It carries
+ * its PageSize, so a container built with a huge-page allocator keeps it
+ * when it grows.
+ */
+template <typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    // Moving a container takes its storage along with its allocator.
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    HugePageAllocator() = default;
+
+    explicit HugePageAllocator(PageSize pages)
+        : pages_(pages)
+    {}
+
+    template <typename U>
+    HugePageAllocator(HugePageAllocator<U> const& other)
+        : pages_(other.pages())
+    {}
+
+    PageSize pages() const { return pages_; }
+
+    T* allocate(size_t n)
+    {
+        if (n > size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T*>(allocate_pages(n * sizeof(T), pages_));
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        deallocate_pages(p, n * sizeof(T), pages_);
+    }
+
+private:
+    PageSize pages_ = PageSize::Normal;
+};
+
+template <typename T, typename U>
+bool operator==(HugePageAllocator<T> const& a, HugePageAllocator<U> const& b)
+{
+    return a.pages() == b.pages();
+}
+
+template <typename T, typename U>
+bool operator!=(HugePageAllocator<T> const& a, HugePageAllocator<U> const& b)
+{
+    return !(a == b);
+}
+
+#endif // EULER67_HUGE_PAGES_H
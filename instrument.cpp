@@ -0,0 +1,251 @@
+/******************************************************
+ *
+ *  Opt-in timing and hardware-counter instrumentation
+ *  for the phases of solving a triangle.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "instrument.h"
+
+#ifndef EULER67_INSTRUMENT
+
+/* Without instrumentation there is nothing to enable and nothing to print.
+ */
+bool instrumentation_available() { return false; }
+void enable_profiling(bool) {}
+void print_profile(std::ostream&, ProfileFormat) {}
+
+#else
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace {
+
+size_t const counter_count = 4;
+
+char const* const counter_names[counter_count] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+};
+
+std::uint64_t const counter_configs[counter_count] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+
+/* The four counters are opened as one perf event group, so they are
+ * scheduled onto the PMU together and one read() returns all of them.
+ */
+class CounterGroup {
+public:
+    ~CounterGroup()
+    {
+        for (int fd: fds_)
+            ::close(fd);
+    }
+
+    bool open()
+    {
+        for (size_t i = 0; i != counter_count; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = counter_configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.disabled = fds_.empty() ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            int leader = fds_.empty() ? -1 : fds_.front();
+            long fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0)
+                return false;
+            fds_.push_back(static_cast<int>(fd));
+        }
+
+        ::ioctl(fds_.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(fds_.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+    }
+
+    void read(unsigned long long (&values)[counter_count]) const
+    {
+        // With PERF_FORMAT_GROUP the kernel writes the number of counters
+        // followed by their values.
+        std::uint64_t buffer[1 + counter_count] = {};
+        if (::read(fds_.front(), buffer, sizeof buffer) < 0)
+            buffer[0] = 0;
+        for (size_t i = 0; i != counter_count; ++i)
+            values[i] = i < buffer[0] ? buffer[1 + i] : 0;
+    }
+
+private:
+    std::vector<int> fds_;
+};
+
+
+struct PhaseTotals {
+    std::string name;
+    unsigned long long calls = 0;
+    long long nanoseconds = 0;
+    unsigned long long counters[counter_count] = {};
+};
+
+struct Profiler {
+    bool enabled = false;
+    bool counters_open = false;
+    CounterGroup counters;
+
+    // There are only a handful of phases, so a linear search is fine.
+    std::vector<PhaseTotals> phases;
+
+    PhaseTotals& totals_for(char const* name)
+    {
+        for (auto& phase: phases)
+            if (phase.name == name)
+                return phase;
+        phases.emplace_back();
+        phases.back().name = name;
+        return phases.back();
+    }
+};
+
+Profiler& profiler()
+{
+    static Profiler instance;
+    return instance;
+}
+
+long long now_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+
+bool instrumentation_available() { return true; }
+
+void enable_profiling(bool hardware_counters)
+{
+    Profiler& p = profiler();
+    p.enabled = true;
+    if (hardware_counters && !p.counters_open)
+        p.counters_open = p.counters.open();
+}
+
+
+ScopedPhase::ScopedPhase(char const* name)
+    : name_(name), active_(profiler().enabled), start_ns_(0)
+{
+    if (!active_)
+        return;
+
+    // Create the entry now so phases are listed in the order they started.
+    profiler().totals_for(name_);
+
+    if (profiler().counters_open)
+        profiler().counters.read(start_counters_);
+    start_ns_ = now_ns();
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    if (!active_)
+        return;
+
+    long long const stop_ns = now_ns();
+    unsigned long long stop_counters[counter_count] = {};
+    if (profiler().counters_open)
+        profiler().counters.read(stop_counters);
+
+    PhaseTotals& totals = profiler().totals_for(name_);
+    totals.calls += 1;
+    totals.nanoseconds += stop_ns - start_ns_;
+    if (profiler().counters_open)
+    {
+        for (size_t i = 0; i != counter_count; ++i)
+            totals.counters[i] += stop_counters[i] - start_counters_[i];
+    }
+}
+
+
+void print_profile(std::ostream& out, ProfileFormat format)
+{
+    Profiler const& p = profiler();
+    if (!p.enabled)
+        return;
+
+    if (format == ProfileFormat::Json)
+    {
+        out << "{\"hardware_counters\":" << (p.counters_open ? "true" : "false")
+            << ",\"phases\":[";
+        for (size_t i = 0; i != p.phases.size(); ++i)
+        {
+            PhaseTotals const& phase = p.phases[i];
+            out << (i ? "," : "")
+                << "{\"name\":\"" << phase.name << "\""
+                << ",\"calls\":" << phase.calls
+                << ",\"seconds\":" << phase.nanoseconds * 1e-9;
+            if (p.counters_open)
+            {
+                for (size_t c = 0; c != counter_count; ++c)
+                    out << ",\"" << counter_names[c] << "\":"
+                        << phase.counters[c];
+            }
+            out << "}";
+        }
+        out << "]}" << std::endl;
+        return;
+    }
+
+    out << std::left << std::setw(20) << "phase"
+        << std::right << std::setw(8) << "calls"
+        << std::setw(14) << "ms";
+    if (p.counters_open)
+    {
+        for (char const* name: counter_names)
+            out << std::setw(16) << name;
+    }
+    out << "\n";
+
+    for (auto const& phase: p.phases)
+    {
+        out << std::left << std::setw(20) << phase.name
+            << std::right << std::setw(8) << phase.calls
+            << std::setw(14) << std::fixed << std::setprecision(3)
+            << phase.nanoseconds * 1e-6;
+        if (p.counters_open)
+        {
+            for (unsigned long long value: phase.counters)
+                out << std::setw(16) << value;
+        }
+        out << "\n";
+    }
+
+    if (!p.counters_open)
+        out << "(hardware counters not enabled or not available)\n";
+    out.flush();
+}
+
+#endif // EULER67_INSTRUMENT
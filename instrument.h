@@ -0,0 +1,81 @@
+/******************************************************
+ *
+ *  Opt-in timing and hardware-counter instrumentation
+ *  for the phases of solving a triangle.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_INSTRUMENT_H
+#define EULER67_INSTRUMENT_H
+
+#include <ostream>
+
+
+/* Instrumentation is compiled in only when EULER67_INSTRUMENT is defined
+ * (build with `make INSTRUMENT=1`). Otherwise `EULER67_PHASE` expands to
+ * nothing and the instrumented code is exactly the uninstrumented code.
+ *
+ * Mark a phase by placing the macro at the top of a scope:
+ *
+ *     {
+ *         EULER67_PHASE("parse_triangle");
+ *         triangle = parse_triangle(stream);
+ *     }
+ *
+ * The time (and, if enabled, the hardware counters) between the macro and
+ * the end of the scope are added to the totals for that phase name.
+ * Phases may nest; each one is measured independently.
+ */
+#ifdef EULER67_INSTRUMENT
+#  define EULER67_PHASE_JOIN2(a, b) a##b
+#  define EULER67_PHASE_JOIN(a, b)  EULER67_PHASE_JOIN2(a, b)
+#  define EULER67_PHASE(name) \
+       ScopedPhase EULER67_PHASE_JOIN(euler67_phase_, __LINE__) {name}
+#else
+#  define EULER67_PHASE(name) ((void)0)
+#endif
+
+
+enum class ProfileFormat { Table, Json };
+
+/* True if this binary was built with EULER67_INSTRUMENT.
+ */
+bool instrumentation_available();
+
+/* Start recording phases. With `hardware_counters`, each phase also counts
+ * cycles, instructions, cache misses and branch misses through
+ * perf_event_open. If the kernel refuses to open the counters, the phases
+ * are still timed and the counters are reported as unavailable.
+ */
+void enable_profiling(bool hardware_counters);
+
+/* Write the totals for every phase, in the order the phases first ran.
+ */
+void print_profile(std::ostream& out, ProfileFormat format);
+
+
+#ifdef EULER67_INSTRUMENT
+
+/* Measures one run of a phase. Use it through `EULER67_PHASE`.
+ */
+class ScopedPhase {
+public:
+    explicit ScopedPhase(char const* name);
+    ~ScopedPhase();
+
+    ScopedPhase(ScopedPhase const&) = delete;
+    ScopedPhase& operator=(ScopedPhase const&) = delete;
+
+private:
+    char const* name_;
+    bool active_;
+    long long start_ns_;
+    unsigned long long start_counters_[4];
+};
+
+#endif
+
+#endif // EULER67_INSTRUMENT_H
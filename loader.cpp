@@ -0,0 +1,472 @@
+/******************************************************
+ *
+ *  An asynchronous loader that reads many triangle
+ *  files at once.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace {
+
+std::string errno_message(std::string const& what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+/* Open a file and size a buffer for its contents. On failure `file.error`
+ * is set and -1 is returned.
+ */
+int open_for_loading(std::string const& path, LoadedFile& file)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        file.error = errno_message("cannot open " + path);
+        return -1;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) < 0)
+    {
+        file.error = errno_message("cannot stat " + path);
+        ::close(fd);
+        return -1;
+    }
+
+    file.contents.resize(static_cast<size_t>(info.st_size));
+    return fd;
+}
+
+
+/* A minimal io_uring, driven through the raw system calls so that we do
+ * not depend on liburing. It only supports what the loader needs: queueing
+ * reads and reaping their completions.
+ */
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(IoUring const&) = delete;
+    IoUring& operator=(IoUring const&) = delete;
+
+    ~IoUring()
+    {
+        if (sqes_)
+            ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ && cq_ring_ != sq_ring_)
+            ::munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_)
+            ::munmap(sq_ring_, sq_ring_size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    /* Returns false if the kernel does not provide a usable io_uring.
+     */
+    bool setup(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof params);
+
+        long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+        fd_ = static_cast<int>(fd);
+
+        // IORING_OP_READ arrived in the same kernel generation as fast
+        // poll, so without that feature we cannot rely on plain reads.
+        if (!(params.features & IORING_FEAT_FAST_POLL))
+            return false;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes
+                      + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        if (!sq_ring_)
+            return false;
+        cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+        if (!cq_ring_)
+            return false;
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+        if (!sqes_)
+            return false;
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_head_  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    unsigned capacity() const { return sq_entries_; }
+
+    /* Queue a read of `size` bytes at `offset` into `buffer`. The read is
+     * not started until the next call to `submit`.
+     */
+    void queue_read(int fd, char* buffer, size_t size, std::uint64_t offset,
+                    std::uint64_t user_data)
+    {
+        unsigned const tail = *sq_tail_;
+        unsigned const index = tail & *sq_mask_;
+
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof sqe);
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = static_cast<unsigned>(std::min<size_t>(size, 1u << 30));
+        sqe.off = offset;
+        sqe.user_data = user_data;
+
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted_;
+    }
+
+    /* Start every queued read and wait until at least `wait_for`
+     * completions are available.
+     */
+    void submit(unsigned wait_for)
+    {
+        if (unsubmitted_ == 0 && wait_for == 0)
+            return;
+
+        for (;;)
+        {
+            long done = ::syscall(__NR_io_uring_enter, fd_, unsubmitted_,
+                                  wait_for,
+                                  wait_for ? IORING_ENTER_GETEVENTS : 0,
+                                  nullptr, 0);
+            if (done >= 0)
+            {
+                unsubmitted_ -= static_cast<unsigned>(done);
+                if (unsubmitted_ == 0 || wait_for == 0)
+                    return;
+                continue;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                throw std::runtime_error(errno_message("io_uring_enter"));
+        }
+    }
+
+    /* Take the next completion, if there is one.
+     */
+    bool next_completion(io_uring_cqe& cqe)
+    {
+        unsigned const head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+            return false;
+
+        cqe = cqes_[head & *cq_mask_];
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_entries_ = 0;
+    unsigned unsubmitted_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    void* map(size_t size, off_t offset)
+    {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd_, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+};
+
+
+/* One file being read by the io_uring backend.
+ */
+struct Slot {
+    int fd = -1;
+    size_t done = 0;        // bytes read so far
+    LoadedFile file;
+};
+
+void load_with_io_uring(IoUring& ring,
+                        std::vector<std::string> const& paths,
+                        std::function<void(LoadedFile&&)> const& on_loaded)
+{
+    std::vector<Slot> slots(ring.capacity());
+    std::vector<size_t> free_slots;
+    for (size_t i = slots.size(); i-- != 0; )
+        free_slots.push_back(i);
+
+    std::deque<LoadedFile> ready;
+    size_t next_file = 0;
+    size_t in_flight = 0;
+
+    auto queue_remaining = [&](size_t s) {
+        Slot& slot = slots[s];
+        ring.queue_read(slot.fd, &slot.file.contents[slot.done],
+                        slot.file.contents.size() - slot.done, slot.done, s);
+    };
+
+    auto finish = [&](size_t s) {
+        Slot& slot = slots[s];
+        ::close(slot.fd);
+        slot.fd = -1;
+        ready.push_back(std::move(slot.file));
+        free_slots.push_back(s);
+        --in_flight;
+    };
+
+    try {
+        while (next_file != paths.size() || in_flight != 0 || !ready.empty())
+        {
+            // Keep the ring as full as we can.
+            while (next_file != paths.size() && !free_slots.empty())
+            {
+                LoadedFile file;
+                file.index = next_file;
+                int fd = open_for_loading(paths[next_file], file);
+                ++next_file;
+
+                if (fd < 0 || file.contents.empty())
+                {
+                    if (fd >= 0)
+                        ::close(fd);
+                    ready.push_back(std::move(file));
+                    continue;
+                }
+
+                size_t s = free_slots.back();
+                free_slots.pop_back();
+                slots[s].fd = fd;
+                slots[s].done = 0;
+                slots[s].file = std::move(file);
+                ++in_flight;
+                queue_remaining(s);
+            }
+
+            // Only block if there is nothing else to do.
+            ring.submit(ready.empty() && in_flight ? 1 : 0);
+
+            io_uring_cqe cqe;
+            while (ring.next_completion(cqe))
+            {
+                size_t const s = static_cast<size_t>(cqe.user_data);
+                Slot& slot = slots[s];
+
+                if (cqe.res < 0)
+                {
+                    errno = -cqe.res;
+                    slot.file.error = errno_message("cannot read "
+                                                    + paths[slot.file.index]);
+                    finish(s);
+                }
+                else if (cqe.res == 0)
+                {
+                    // The file shrank after we sized the buffer.
+                    slot.file.contents.resize(slot.done);
+                    finish(s);
+                }
+                else
+                {
+                    slot.done += static_cast<size_t>(cqe.res);
+                    if (slot.done == slot.file.contents.size())
+                        finish(s);
+                    else
+                        queue_remaining(s);
+                }
+            }
+
+            // Start the reads we just queued before handing anything over,
+            // so the kernel works while the caller parses.
+            ring.submit(0);
+
+            while (!ready.empty())
+            {
+                LoadedFile file = std::move(ready.front());
+                ready.pop_front();
+                on_loaded(std::move(file));
+            }
+        }
+    }
+    catch (...) {
+        // The kernel may still be writing into buffers we own, so wait for
+        // every outstanding read before they are destroyed.
+        try {
+            io_uring_cqe cqe;
+            while (in_flight != 0)
+            {
+                ring.submit(1);
+                while (ring.next_completion(cqe))
+                    --in_flight;
+            }
+        }
+        catch (...) {
+        }
+        for (auto& slot: slots)
+            if (slot.fd >= 0)
+                ::close(slot.fd);
+        throw;
+    }
+}
+
+
+LoadedFile read_with_pread(std::string const& path, size_t index)
+{
+    LoadedFile file;
+    file.index = index;
+
+    int fd = open_for_loading(path, file);
+    if (fd < 0)
+        return file;
+
+    size_t done = 0;
+    while (done != file.contents.size())
+    {
+        ssize_t got = ::pread(fd, &file.contents[done],
+                              file.contents.size() - done, done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+        {
+            file.error = errno_message("cannot read " + path);
+            break;
+        }
+        if (got == 0)
+        {
+            file.contents.resize(done);
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+
+    ::close(fd);
+    return file;
+}
+
+void load_with_thread_pool(unsigned thread_count,
+                           std::vector<std::string> const& paths,
+                           std::function<void(LoadedFile&&)> const& on_loaded)
+{
+    std::atomic<size_t> next_file {0};
+    std::atomic<bool> stop {false};
+
+    std::mutex mutex;
+    std::condition_variable loaded;
+    std::deque<LoadedFile> ready;
+
+    auto worker = [&] {
+        for (;;)
+        {
+            size_t i = next_file++;
+            if (i >= paths.size() || stop)
+                return;
+
+            LoadedFile file = read_with_pread(paths[i], i);
+
+            std::lock_guard<std::mutex> lock {mutex};
+            ready.push_back(std::move(file));
+            loaded.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i != std::max(1u, thread_count); ++i)
+        threads.emplace_back(worker);
+
+    try {
+        for (size_t delivered = 0; delivered != paths.size(); ++delivered)
+        {
+            LoadedFile file;
+            {
+                std::unique_lock<std::mutex> lock {mutex};
+                loaded.wait(lock, [&] { return !ready.empty(); });
+                file = std::move(ready.front());
+                ready.pop_front();
+            }
+            on_loaded(std::move(file));
+        }
+    }
+    catch (...) {
+        stop = true;
+        for (auto& thread: threads)
+            thread.join();
+        throw;
+    }
+
+    for (auto& thread: threads)
+        thread.join();
+}
+
+} // namespace
+
+
+LoaderBackend load_files(std::vector<std::string> const& paths,
+                         std::function<void(LoadedFile&&)> const& on_loaded,
+                         LoaderOptions const& options)
+{
+    if (options.backend != LoaderBackend::ThreadPool)
+    {
+        IoUring ring;
+        if (ring.setup(std::max(1u, options.queue_depth)))
+        {
+            load_with_io_uring(ring, paths, on_loaded);
+            return LoaderBackend::IoUring;
+        }
+        if (options.backend == LoaderBackend::IoUring)
+            throw std::runtime_error("io_uring is not available");
+    }
+
+    load_with_thread_pool(options.threads, paths, on_loaded);
+    return LoaderBackend::ThreadPool;
+}
@@ -0,0 +1,56 @@
+/******************************************************
+ *
+ *  An asynchronous loader that reads many triangle
+ *  files at once.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_LOADER_H
+#define EULER67_LOADER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+/* The contents of one file, or the reason it could not be read.
+ */
+struct LoadedFile {
+    size_t index;            // position of the file in the list of paths
+    std::string contents;
+    std::string error;       // empty on success
+};
+
+enum class LoaderBackend {
+    Auto,        // io_uring if the kernel supports it, else the thread pool
+    IoUring,
+    ThreadPool,
+};
+
+struct LoaderOptions {
+    LoaderBackend backend = LoaderBackend::Auto;
+
+    // The most reads the io_uring backend keeps in flight at once.
+    unsigned queue_depth = 64;
+
+    // The number of threads calling pread() in the fallback backend.
+    unsigned threads = 8;
+};
+
+/* Read every file in `paths` and hand each one to `on_loaded` as soon as
+ * it has been read, in whatever order the reads complete.
+ *
+ * `on_loaded` always runs on the calling thread. While it runs (typically
+ * parsing and folding the triangle), the reads of the other files carry on
+ * in the kernel or in the pool threads, so I/O overlaps with parsing.
+ *
+ * Returns the backend that was actually used.
+ */
+LoaderBackend load_files(std::vector<std::string> const& paths,
+                         std::function<void(LoadedFile&&)> const& on_loaded,
+                         LoaderOptions const& options = LoaderOptions());
+
+#endif // EULER67_LOADER_H
@@ -0,0 +1,112 @@
+/******************************************************
+ *
+ *  A Triangle that is read straight out of a binary
+ *  triangle file mapped into memory.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "mapped_triangle.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+std::string errno_message(std::string const& what)
+{
+    return what + ": " + std::strerror(errno);
+}
+
+// Closes the file on every path out of the constructor. The mapping stays
+// valid after the file is closed.
+struct FileDescriptor {
+    int fd;
+    ~FileDescriptor() { if (fd >= 0) ::close(fd); }
+};
+
+} // namespace
+
+
+MappedTriangle::MappedTriangle(std::string const& path,
+                               MappedTriangleOptions const& options)
+    : map_(MAP_FAILED), size_(0), values_(nullptr), height_(0),
+      options_(options)
+{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    throw std::runtime_error("MappedTriangle needs a little-endian host");
+#endif
+
+    FileDescriptor file { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+    if (file.fd < 0)
+        throw std::runtime_error(errno_message("cannot open " + path));
+
+    struct stat status;
+    if (::fstat(file.fd, &status) != 0)
+        throw std::runtime_error(errno_message("fstat " + path));
+
+    size_ = static_cast<std::uint64_t>(status.st_size);
+    if (size_ < binary_header_size)
+        throw std::runtime_error(path + " is too short to be a triangle");
+
+    int flags = MAP_SHARED;
+    if (options_.populate)
+        flags |= MAP_POPULATE;
+
+    map_ = ::mmap(nullptr, size_, PROT_READ, flags, file.fd, 0);
+    if (map_ == MAP_FAILED)
+        throw std::runtime_error(errno_message("mmap " + path));
+
+    try {
+        unsigned char const* bytes = static_cast<unsigned char const*>(map_);
+        std::uint64_t const height = decode_binary_header(bytes);
+        if (height > size_ || binary_row_offset(height) > size_)
+            throw std::runtime_error("truncated binary triangle");
+
+        // The header is 32 bytes and the mapping is page aligned, so the
+        // values are aligned for int.
+        height_ = static_cast<size_t>(height);
+        values_ = reinterpret_cast<int const*>(bytes + binary_header_size);
+    }
+    catch (...) {
+        ::munmap(map_, size_);
+        throw;
+    }
+}
+
+MappedTriangle::~MappedTriangle()
+{
+    ::munmap(map_, size_);
+}
+
+void MappedTriangle::read_ahead(size_t r, std::uint64_t& advised) const
+{
+    std::uint64_t const window = options_.readahead_bytes;
+    if (options_.populate || window == 0)
+        return;
+
+    // Nothing to do while the row is well inside the part already asked for.
+    std::uint64_t const start = binary_row_offset(r);
+    if (start < advised && advised - start > window / 2)
+        return;
+
+    // madvise needs a page-aligned start; rounding down only asks for a
+    // little more.
+    std::uint64_t const page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+    std::uint64_t const first = (start > window ? start - window : 0) / page * page;
+    if (first >= advised)
+        return;
+
+    // This is only advice, so a failure is not worth reporting.
+    ::madvise(static_cast<char*>(map_) + first, advised - first, MADV_WILLNEED);
+    advised = first;
+}
@@ -0,0 +1,154 @@
+/******************************************************
+ *
+ *  A Triangle that is read straight out of a binary
+ *  triangle file mapped into memory.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_MAPPED_TRIANGLE_H
+#define EULER67_MAPPED_TRIANGLE_H
+
+#include "triangle.h"
+#include "triangle_file.h"
+
+#include <cstdint>
+#include <string>
+
+
+/* Options for mapping a triangle file.
+ */
+struct MappedTriangleOptions {
+    // Read the whole file in when it is mapped (MAP_POPULATE). Opening then
+    // takes as long as reading the file, but the folds never wait for it.
+    bool populate = false;
+
+    // Otherwise the folds ask the kernel (MADV_WILLNEED) to start reading
+    // this many bytes of the file ahead of the row they are folding. 0
+    // leaves every page to be faulted in when it is first touched.
+    size_t readahead_bytes = 8 << 20;
+
+    // While folding row `r`, prefetch row `r - prefetch_rows` into the
+    // cache (0 for none). This only helps once the kernel has read the row
+    // in: a prefetch of a page that is not in memory is dropped.
+    size_t prefetch_rows = default_prefetch_rows;
+};
+
+/* A MappedTriangle is a read-only Triangle whose values are the values of a
+ * binary triangle file (see triangle_file.h), mapped with mmap() instead of
+ * copied. Opening one only reads the header, so it takes the same time for
+ * any size of file, and every process that maps the same file shares the
+ * one copy in the page cache.
+ *
+ * The file format stores values as little-endian 32-bit integers, row
+ * after row, which is exactly the layout of `Triangle`, so the rows are
+ * handed out as RowViews into the mapping. On a big-endian host the
+ * constructor throws, since the values would need converting.
+ *
+ * The mapping is shared, so the file must not be truncated while it is
+ * mapped; a write to it shows up in the triangle.
+ */
+class MappedTriangle {
+public:
+    explicit MappedTriangle(std::string const& path,
+                            MappedTriangleOptions const& options
+                                = MappedTriangleOptions());
+    ~MappedTriangle();
+
+    MappedTriangle(MappedTriangle const&) = delete;
+    MappedTriangle& operator=(MappedTriangle const&) = delete;
+
+    size_t height() const { return height_; }
+    size_t width() const { return height_; }
+
+    RowView row(size_t r) const
+    {
+        return RowView(values_ + triangle_row_offset(r), r + 1);
+    }
+
+    RowRange rows() const
+    {
+        return RowRange(values_, height_);
+    }
+
+    int const* data() const
+    {
+        return values_;
+    }
+
+    /* Called by the folds before they fold row `r`. The folds move up the
+     * file, so this asks the kernel to read the `readahead_bytes` before
+     * `advised`, the start of the part already asked for, once row `r`
+     * comes within half of that distance of it, and moves `advised` down.
+     * Start with `advised` at `file_size()`.
+     */
+    void read_ahead(size_t r, std::uint64_t& advised) const;
+
+    std::uint64_t file_size() const { return size_; }
+
+    size_t prefetch_rows() const { return options_.prefetch_rows; }
+
+private:
+    void* map_;
+    std::uint64_t size_;
+    int const* values_;
+    size_t height_;
+    MappedTriangleOptions options_;
+};
+
+
+/* fold_triangle<T>(mapped, make_t, combine_t, workspace)
+ *     - the same fold as `fold_triangle<T>` on a Triangle, reading the rows
+ *       from the mapping and reading ahead of itself as it goes, and
+ *       prefetching as set by the triangle's options.
+ */
+template <typename T>
+T fold_triangle(MappedTriangle const& triangle,
+       std::function<T(int)> const& make_t,
+       std::function<T(int,T,T)> const& combine_t,
+       FoldWorkspace<T>& workspace)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle expects a non-empty triangle");
+    }
+
+    std::vector<T>& accum = workspace.accum(triangle.width());
+    std::uint64_t advised = triangle.file_size();
+
+    triangle.read_ahead(triangle.height() - 1, advised);
+    for (int value: triangle.row(triangle.height() - 1))
+        accum.emplace_back(make_t(value));
+
+    size_t const ahead = triangle.prefetch_rows();
+    for (size_t r = triangle.height() - 1; r-- != 0; )
+    {
+        triangle.read_ahead(r, advised);
+
+        RowView const row = triangle.row(r);
+        if (ahead != 0 && r >= ahead)
+            fold_row<T>(accum, row.data(), row.size(), combine_t,
+                        triangle.row(r - ahead));
+        else
+            fold_row<T>(accum, row.data(), row.size(), combine_t);
+    }
+    return accum.front();
+}
+
+inline int max_path(MappedTriangle const& triangle)
+{
+    auto leaf = [](int i) -> int { return i; };
+    return fold_triangle<int>(triangle, leaf, max_path_combine,
+                              thread_workspace<int>());
+}
+
+inline int max_odd_even_path(MappedTriangle const& triangle)
+{
+    auto leaf = [](int i) -> int { return i; };
+    return fold_triangle<int>(triangle, leaf, odd_even_path_combine,
+                              thread_workspace<int>());
+}
+
+#endif // EULER67_MAPPED_TRIANGLE_H
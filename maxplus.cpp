@@ -0,0 +1,195 @@
+/******************************************************
+ *
+ *  The maximum path fold as a product of max-plus
+ *  matrices, which can be combined in parallel.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "maxplus.h"
+
+#include <algorithm>      // std::max
+#include <climits>        // INT_MIN
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+
+BandOperator::BandOperator(RowBand band)
+    : band_(band)
+{
+    if (band_.end <= band_.first)
+        throw std::invalid_argument("BandOperator requires a non-empty band");
+
+    entries_.assign(rows() * bandwidth(), INT_MIN);
+}
+
+BandOperator::BandOperator(Triangle const& triangle, RowBand band)
+    : BandOperator(band)
+{
+    if (band_.end > triangle.height())
+        throw std::invalid_argument("BandOperator band is outside the triangle");
+
+    size_t const width = bandwidth();
+
+    // While it is built, the operator has a row for every position of
+    // every row of the band; only the top row's are kept.
+    entries_.assign(band_.end * width, INT_MIN);
+
+    /* Build the operator from the bottom row of the band up, exactly like
+     * the fold itself, except that each position carries a whole row of
+     * the matrix instead of a single value. Row r is folded into the rows
+     * i <= r of `entries_` in place: row i only needs the old rows i and
+     * i + 1, and d is walked downwards so that the old M[i][d] is read
+     * before it is overwritten.
+     */
+    size_t const last = band_.end - 1;
+    for (size_t i = 0; i <= last; ++i)
+    {
+        int const value = triangle.at(last, i);
+        entries_[i * width + 0] = value;
+        entries_[i * width + 1] = value;
+    }
+
+    for (size_t r = last; r-- != band_.first; )
+    {
+        // Paths from row r reach at most `end - r` positions to the right.
+        size_t const reach = band_.end - r;
+
+        for (size_t i = 0; i <= r; ++i)
+        {
+            int const value = triangle.at(r, i);
+            int* row = &entries_[i * width];
+            int const* right = &entries_[(i + 1) * width];
+
+            for (size_t d = reach + 1; d-- != 0; )
+            {
+                // Step down-left onto M[i][d], or down-right onto M[i+1][d-1].
+                int best = d < reach ? row[d] : INT_MIN;
+                if (d >= 1)
+                    best = std::max(best, right[d - 1]);
+                row[d] = value + best;
+            }
+        }
+    }
+
+    entries_.resize(rows() * width);
+    entries_.shrink_to_fit();
+}
+
+BandOperator compose(BandOperator const& upper, BandOperator const& lower)
+{
+    if (upper.band_.end != lower.band_.first)
+        throw std::invalid_argument("compose requires adjacent bands");
+
+    BandOperator result {RowBand { upper.band_.first, lower.band_.end }};
+
+    size_t const upper_width = upper.bandwidth();
+    size_t const lower_width = lower.bandwidth();
+    size_t const width = result.bandwidth();
+
+    /* R[i][i+d] = max over e of U[i][i+e] + L[i+e][i+d]. Every entry of
+     * both operators is a real path sum, so no entry is ever "minus
+     * infinity" and no overflow checks are needed beyond those of the fold.
+     */
+    for (size_t i = 0; i != result.rows(); ++i)
+    {
+        int* out = &result.entries_[i * width];
+        for (size_t e = 0; e != upper_width; ++e)
+        {
+            int const through = upper.at(i, e);
+            int const* in = &lower.entries_[(i + e) * lower_width];
+            for (size_t d = 0; d != lower_width; ++d)
+                out[e + d] = std::max(out[e + d], through + in[d]);
+        }
+    }
+    return result;
+}
+
+std::vector<int> BandOperator::apply(RowView below) const
+{
+    if (below.size() != band_.end + 1)
+        throw std::invalid_argument("BandOperator::apply: wrong input size");
+
+    std::vector<int> out(rows(), INT_MIN);
+    for (size_t i = 0; i != rows(); ++i)
+        for (size_t d = 0; d != bandwidth(); ++d)
+            out[i] = std::max(out[i], at(i, d) + below[i + d]);
+    return out;
+}
+
+
+namespace {
+
+/* Run `task(i)` for every i below `count`, each on its own thread, and
+ * rethrow the first failure.
+ */
+template <typename Task>
+void run_parallel(size_t count, Task const& task)
+{
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != count; ++i)
+    {
+        threads.emplace_back([&, i] {
+            try {
+                task(i);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread: threads)
+        thread.join();
+    for (auto const& error: errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+} // namespace
+
+
+int max_path_maxplus(Triangle const& triangle, unsigned threads)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "max_path_maxplus expects a non-empty triangle");
+    }
+    if (threads == 0)
+        throw std::invalid_argument("max_path_maxplus needs at least one thread");
+
+    // The bottom row is the input vector; the operators cover the rest.
+    size_t const bottom = triangle.height() - 1;
+    if (threads == 1 || bottom == 0)
+        return max_path(triangle);
+
+    std::vector<RowBand> const bands = partition_rows(bottom, threads);
+
+    std::vector<std::unique_ptr<BandOperator>> operators(bands.size());
+    run_parallel(bands.size(), [&](size_t b) {
+        operators[b].reset(new BandOperator(triangle, bands[b]));
+    });
+
+    // Compose neighbours pairwise, upper with lower, until one is left.
+    while (operators.size() > 1)
+    {
+        std::vector<std::unique_ptr<BandOperator>> next((operators.size() + 1) / 2);
+
+        run_parallel(operators.size() / 2, [&](size_t p) {
+            next[p].reset(new BandOperator(
+                compose(*operators[2 * p], *operators[2 * p + 1])));
+        });
+        if (operators.size() % 2)
+            next.back() = std::move(operators.back());
+
+        operators = std::move(next);
+    }
+
+    RowView const leaves = triangle.row(bottom);
+    return operators.front()->apply(leaves).front();
+}
@@ -0,0 +1,89 @@
+/******************************************************
+ *
+ *  The maximum path fold as a product of max-plus
+ *  matrices, which can be combined in parallel.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_MAXPLUS_H
+#define EULER67_MAXPLUS_H
+
+#include "triangle.h"
+#include "banded_fold.h"  // RowBand
+
+#include <vector>
+
+
+/* In max-plus algebra, "addition" is max and "multiplication" is +. One
+ * step of `max_path` is then a max-plus linear map from the accumulator of
+ * the row below to that of row r:
+ *
+ *     out[i] = max(v[r][i] + in[i], v[r][i] + in[i+1])
+ *
+ * The product of those maps for the rows of a band [first, end) is a
+ * matrix M with
+ *
+ *     out[i] = max over j of (M[i][j] + in[j])
+ *
+ * where M[i][j] is the best sum of a path from row `first`, position i,
+ * down to row `end - 1` that then steps onto position j of row `end`. Such
+ * a path can only drift right by at most one position per row, so M[i][j]
+ * is only defined for i <= j <= i + (end - first): the matrix is banded,
+ * and only that band is stored.
+ *
+ * Because matrix products are associative, the operators of adjacent bands
+ * can be combined in any grouping, which is what lets the fold run as a
+ * parallel reduction instead of a strict row-by-row chain.
+ *
+ * This only works for `max_path`. The odd/even rule looks at the parity of
+ * the results below, which is not a max-plus linear map.
+ */
+class BandOperator {
+public:
+    /* The operator of the rows of `band`, which must not be empty.
+     */
+    BandOperator(Triangle const& triangle, RowBand band);
+
+    RowBand band() const { return band_; }
+
+    size_t rows() const { return band_.first + 1; }
+    size_t bandwidth() const { return band_.end - band_.first + 1; }
+
+    /* M[i][i + d], for i < rows() and d < bandwidth().
+     */
+    int at(size_t i, size_t d) const { return entries_[i * bandwidth() + d]; }
+
+    /* The operator of `upper` followed by `lower`, which must be the band
+     * directly below it: first the rows of `lower` are folded, then those
+     * of `upper`.
+     */
+    friend BandOperator compose(BandOperator const& upper,
+                                BandOperator const& lower);
+
+    /* Fold the rows of the band into `below`, the accumulator of row
+     * `band().end`, which has `band().end + 1` values.
+     */
+    std::vector<int> apply(RowView below) const;
+
+private:
+    explicit BandOperator(RowBand band);
+
+    RowBand band_;
+    std::vector<int> entries_;
+};
+
+/* Compute `max_path(triangle)` by splitting the triangle into bands, one
+ * per thread, building each band's operator on its own thread and then
+ * composing the operators pairwise in a tree, also in parallel, so the
+ * depth of the combination is O(log threads).
+ *
+ * Building a band's operator costs about (band height) times as much as
+ * folding it, so this pays off only for very tall triangles and many
+ * cores. With one thread it is an ordinary fold.
+ */
+int max_path_maxplus(Triangle const& triangle, unsigned threads);
+
+#endif // EULER67_MAXPLUS_H
@@ -0,0 +1,215 @@
+/******************************************************
+ *
+ *  A parallel fold that keeps each thread's part of the
+ *  triangle in the memory of the socket it runs on.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       // sched_setaffinity, CPU_SET
+#endif
+
+#include "numa_fold.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace {
+
+/* Parse a list such as "0-3,8-11" from /sys. Returns false if `path`
+ * cannot be read.
+ */
+bool read_id_list(std::string const& path, std::vector<int>& ids)
+{
+    std::ifstream file {path};
+    std::string list;
+    if (!std::getline(file, list))
+        return false;
+
+    std::istringstream ranges {list};
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        if (range.empty())
+            continue;
+        size_t const dash = range.find('-');
+        int const low = std::stoi(range.substr(0, dash));
+        int const high = dash == std::string::npos
+                       ? low : std::stoi(range.substr(dash + 1));
+        for (int id = low; id <= high; ++id)
+            ids.push_back(id);
+    }
+    return true;
+}
+
+std::vector<NumaNode> discover_nodes()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof allowed, &allowed) != 0)
+        CPU_ZERO(&allowed);
+
+    std::vector<int> all_cpus;
+    for (int cpu = 0; cpu != CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed))
+            all_cpus.push_back(cpu);
+
+    std::vector<NumaNode> nodes;
+    std::vector<int> ids;
+    if (read_id_list("/sys/devices/system/node/online", ids))
+    {
+        for (int id: ids)
+        {
+            std::vector<int> cpus;
+            read_id_list("/sys/devices/system/node/node" + std::to_string(id)
+                         + "/cpulist", cpus);
+
+            NumaNode node { id, {} };
+            for (int cpu: cpus)
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                    node.cpus.push_back(cpu);
+            if (!node.cpus.empty())
+                nodes.push_back(node);
+        }
+    }
+
+    if (nodes.empty())
+        nodes.push_back(NumaNode { -1, all_cpus });
+    return nodes;
+}
+
+
+/* glibc has no wrapper for set_mempolicy; libnuma has one, but it is not
+ * worth a dependency for one system call.
+ */
+void set_memory_policy(Placement placement, NumaNode const& node)
+{
+    std::vector<NumaNode> const& nodes = numa_nodes();
+    if (nodes.front().id < 0)
+        return;
+
+    unsigned long mask[16] = {};
+    size_t const bits = 8 * sizeof mask;
+    auto add = [&](int id) {
+        if (id >= 0 && size_t(id) < bits)
+            mask[id / (8 * sizeof *mask)] |= 1ul << (id % (8 * sizeof *mask));
+    };
+
+    int mode;
+    if (placement == Placement::Local)
+    {
+        mode = MPOL_PREFERRED;
+        add(node.id);
+    }
+    else
+    {
+        mode = MPOL_INTERLEAVE;
+        for (NumaNode const& other: nodes)
+            add(other.id);
+    }
+
+    // Only a preference: if the kernel refuses, first touch still places
+    // Local memory on the node the thread is pinned to.
+    ::syscall(SYS_set_mempolicy, mode, mask, bits);
+}
+
+void pin_to(NumaNode const& node)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu: node.cpus)
+        CPU_SET(cpu, &set);
+    ::sched_setaffinity(0, sizeof set, &set);
+}
+
+} // namespace
+
+
+std::vector<NumaNode> const& numa_nodes()
+{
+    static std::vector<NumaNode> const nodes = discover_nodes();
+    return nodes;
+}
+
+void run_on_nodes(std::vector<size_t> const& nodes, Placement placement,
+                  std::function<void(size_t)> const& task)
+{
+    std::vector<std::exception_ptr> errors(nodes.size());
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != nodes.size(); ++t)
+    {
+        threads.emplace_back([&, t] {
+            try {
+                NumaNode const& node = numa_nodes().at(nodes[t]);
+                pin_to(node);
+                set_memory_policy(placement, node);
+                task(t);
+            }
+            catch (...) {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread: threads)
+        thread.join();
+    for (auto const& error: errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+
+NumaTriangle::NumaTriangle(Triangle const& triangle, NumaOptions const& options)
+    : height_(triangle.height()), placement_(options.placement)
+{
+    size_t count = options.threads;
+    if (count == 0)
+        count = std::max(1u, std::thread::hardware_concurrency());
+    count = std::max<size_t>(1, std::min(count, height_));
+
+    // Consecutive threads go to the same node, so that the results they
+    // exchange at the edges of their columns are mostly in the same node.
+    size_t const node_count = numa_nodes().size();
+    columns_.resize(count);
+    for (size_t t = 0; t != count; ++t)
+    {
+        columns_[t].first = height_ * t / count;
+        columns_[t].end = height_ * (t + 1) / count;
+        columns_[t].node = t * node_count / count;
+    }
+
+    run_on_nodes(nodes(), placement_, [&](size_t t) {
+        Columns& mine = columns_[t];
+
+        size_t size = 0;
+        for (size_t r = mine.first; r < height_; ++r)
+            size += std::min(mine.end, r + 1) - mine.first;
+        mine.values.reserve(size);
+
+        for (size_t r = height_; r-- > mine.first; )
+        {
+            RowView const row = triangle.row(r);
+            mine.values.insert(mine.values.end(),
+                               row.begin() + mine.first,
+                               row.begin() + std::min(mine.end, r + 1));
+        }
+    });
+}
+
+std::vector<size_t> NumaTriangle::nodes() const
+{
+    std::vector<size_t> result;
+    for (Columns const& columns: columns_)
+        result.push_back(columns.node);
+    return result;
+}
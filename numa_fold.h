@@ -0,0 +1,241 @@
+/******************************************************
+ *
+ *  A parallel fold that keeps each thread's part of the
+ *  triangle in the memory of the socket it runs on.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_NUMA_FOLD_H
+#define EULER67_NUMA_FOLD_H
+
+#include "triangle.h"
+
+#include <algorithm>      // std::min
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+/* Where the memory of a NumaTriangle is placed.
+ *
+ *   - Local: each thread's part is on the NUMA node the thread runs on.
+ *   - Interleaved: every part is spread page by page over all the nodes,
+ *     which is what memory allocated without any care ends up like on
+ *     average. Useful as a baseline.
+ */
+enum class Placement {
+    Local,
+    Interleaved,
+};
+
+struct NumaOptions {
+    unsigned threads = 0;                 // 0 for one per CPU
+    Placement placement = Placement::Local;
+};
+
+
+/* A NUMA node, with the CPUs on it that this process may run on.
+ */
+struct NumaNode {
+    int id;                   // -1 if the machine does not report its nodes
+    std::vector<int> cpus;
+};
+
+/* The NUMA nodes of this machine, read once from /sys. Nodes without any
+ * CPU this process may use are left out. Machines without NUMA (or
+ * without /sys) are one node, with id -1, holding every CPU.
+ */
+std::vector<NumaNode> const& numa_nodes();
+
+/* Run `task(t)` for every t below `nodes.size()`, each on its own thread
+ * pinned to the CPUs of `numa_nodes()[nodes[t]]` and allocating memory by
+ * `placement`, and rethrow the first failure. Pinning and the memory
+ * policy are best effort: where the kernel refuses them, the thread runs
+ * as it would have anyway.
+ */
+void run_on_nodes(std::vector<size_t> const& nodes, Placement placement,
+                  std::function<void(size_t)> const& task);
+
+
+/* The threads of a parallel fold wait for each other after every row.
+ * Rows near the top are tiny, so this spins, yielding in case there are
+ * more threads than CPUs.
+ */
+class RowBarrier {
+public:
+    explicit RowBarrier(size_t threads)
+        : threads_(threads), waiting_(0), generation_(0)
+    {}
+
+    void wait()
+    {
+        size_t const generation = generation_.load(std::memory_order_acquire);
+        if (waiting_.fetch_add(1, std::memory_order_acq_rel) + 1 == threads_)
+        {
+            waiting_.store(0, std::memory_order_relaxed);
+            generation_.store(generation + 1, std::memory_order_release);
+            return;
+        }
+        for (unsigned spins = 0;
+             generation_.load(std::memory_order_acquire) == generation; ++spins)
+        {
+            if (spins >= 64)
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    size_t const threads_;
+    std::atomic<size_t> waiting_;
+    std::atomic<size_t> generation_;
+};
+
+
+/* A NumaTriangle is a copy of a Triangle split by columns among a fixed set
+ * of threads, for `fold`, which folds it in parallel.
+ *
+ * Each row of the fold only depends on the row below, so the columns of a
+ * row can be folded by different threads, which meet after every row. A
+ * thread always folds the same columns, so it only ever reads its own
+ * columns of the triangle and its own part of the accumulator, plus one
+ * result of its neighbour's. The threads are spread over the NUMA nodes
+ * and pinned there, and each one copies its columns of the triangle (and
+ * later allocates its part of the accumulator) itself, so that with
+ * Placement::Local the kernel's first-touch policy, backed by an explicit
+ * memory policy, puts them in its own node's memory.
+ *
+ * The columns are split evenly. Column i has `height - i` values, so the
+ * threads with the leftmost columns do the most work, and the threads
+ * with the rightmost ones run out of work as the rows get shorter; the
+ * fold is most worthwhile for tall triangles.
+ */
+class NumaTriangle {
+public:
+    NumaTriangle(Triangle const& triangle, NumaOptions const& options = NumaOptions());
+
+    size_t height() const { return height_; }
+    size_t threads() const { return columns_.size(); }
+    Placement placement() const { return placement_; }
+
+    /* The same result as `fold_triangle<T>` on the original triangle.
+     */
+    template <typename T>
+    T fold(std::function<T(int)> const& make_t,
+           std::function<T(int,T,T)> const& combine_t) const;
+
+private:
+    struct Columns {
+        size_t first;
+        size_t end;
+        size_t node;          // index into numa_nodes()
+
+        // Columns [first, end) of every row that has any of them, from the
+        // bottom row up, in the order the fold reads them.
+        std::vector<int> values;
+    };
+
+    size_t height_;
+    Placement placement_;
+    std::vector<Columns> columns_;
+
+    std::vector<size_t> nodes() const;
+};
+
+
+template <typename T>
+T NumaTriangle::fold(std::function<T(int)> const& make_t,
+                     std::function<T(int,T,T)> const& combine_t) const
+{
+    if (height_ == 0) {
+        throw std::invalid_argument(
+            "NumaTriangle::fold expects a non-empty triangle");
+    }
+
+    size_t const count = threads();
+
+    // Two results per column, one for the row being folded and one for the
+    // row below it, swapping at every row. Each thread fills in its own, so
+    // they are placed like its part of the triangle.
+    std::vector<std::vector<T>> results[2];
+    results[0].resize(count);
+    results[1].resize(count);
+
+    RowBarrier barrier {count};
+    std::atomic<bool> failed {false};
+
+    run_on_nodes(nodes(), placement_, [&](size_t t) {
+        Columns const& mine = columns_[t];
+        size_t const first = mine.first;
+        size_t const end = mine.end;
+        int const* values = mine.values.data();
+
+        // A thread that fails keeps meeting the others at every row, so
+        // that none of them waits forever, but stops folding.
+        std::exception_ptr error;
+        try {
+            std::vector<T>& bottom = results[(height_ - 1) & 1][t];
+            bottom.reserve(end - first);
+            for (size_t i = first; i != end; ++i)
+                bottom.push_back(make_t(*values++));
+            results[height_ & 1][t] = bottom;
+        }
+        catch (...) {
+            error = std::current_exception();
+            failed.store(true, std::memory_order_relaxed);
+        }
+        barrier.wait();
+
+        // Row r is folded into results[r & 1] from results[(r + 1) & 1].
+        // The barrier after each row also guarantees that nobody is still
+        // reading results[r & 1] from the row before when it is reused.
+        for (size_t r = height_ - 1; r-- != 0; )
+        {
+            if (first <= r && !failed.load(std::memory_order_relaxed))
+            {
+                try {
+                    std::vector<T> const& below = results[(r + 1) & 1][t];
+                    std::vector<T>& row = results[r & 1][t];
+
+                    size_t const last = std::min(end, r + 1);
+                    for (size_t i = first; i != last; ++i)
+                    {
+                        T const& right = i + 1 < end
+                            ? below[i + 1 - first]
+                            : results[(r + 1) & 1][t + 1].front();
+                        row[i - first] = combine_t(*values++, below[i - first], right);
+                    }
+                }
+                catch (...) {
+                    error = std::current_exception();
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            barrier.wait();
+        }
+
+        if (error)
+            std::rethrow_exception(error);
+    });
+
+    return results[0][0].front();
+}
+
+inline int max_path(NumaTriangle const& triangle)
+{
+    auto leaf = [](int i) -> int { return i; };
+    return triangle.fold<int>(leaf, max_path_combine);
+}
+
+inline int max_odd_even_path(NumaTriangle const& triangle)
+{
+    auto leaf = [](int i) -> int { return i; };
+    return triangle.fold<int>(leaf, odd_even_path_combine);
+}
+
+#endif // EULER67_NUMA_FOLD_H
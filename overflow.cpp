@@ -0,0 +1,251 @@
+/******************************************************
+ *
+ *  Folds that decide what happens when a path sum
+ *  does not fit in an int.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "overflow.h"
+#include "dispatch.h"
+
+#include <algorithm>      // std::max
+#include <climits>        // INT_MAX, INT_MIN
+#include <cstdint>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EULER67_OVERFLOW_AVX2 1
+#endif
+
+
+namespace {
+
+/* The two combining rules, split into choosing the best result below and
+ * adding the value on top, since only the addition can overflow.
+ */
+struct MaxPathRule {
+    static int best(int left, int right)
+    {
+        return std::max(left, right);
+    }
+
+    static long long best(long long left, long long right)
+    {
+        return std::max(left, right);
+    }
+
+#ifdef EULER67_OVERFLOW_AVX2
+    __attribute__((target("avx2")))
+    static __m256i best(__m256i left, __m256i right)
+    {
+        return _mm256_max_epi32(left, right);
+    }
+#endif
+};
+
+struct OddEvenPathRule {
+    static int best(int left, int right)
+    {
+        return std::max(left % 2 == 0 ? 0 : left,
+                        right % 2 == 0 ? right : 0);
+    }
+
+    static long long best(long long left, long long right)
+    {
+        return std::max(left % 2 == 0 ? 0 : left,
+                        right % 2 == 0 ? right : 0);
+    }
+
+#ifdef EULER67_OVERFLOW_AVX2
+    // The same selection as `odd_even_path_combine`; see packed_triangle.cpp.
+    __attribute__((target("avx2")))
+    static __m256i best(__m256i left, __m256i right)
+    {
+        __m256i const one = _mm256_set1_epi32(1);
+        __m256i const left_odd = _mm256_sub_epi32(
+            _mm256_setzero_si256(), _mm256_and_si256(left, one));
+        __m256i const right_even = _mm256_sub_epi32(
+            _mm256_and_si256(right, one), one);
+        return _mm256_max_epi32(_mm256_and_si256(left, left_odd),
+                                _mm256_and_si256(right, right_even));
+    }
+#endif
+};
+
+
+/* Scalar additions under each policy. `overflow` collects, in its sign
+ * bit, whether any checked addition overflowed: the sum of two ints
+ * overflowed exactly when its sign differs from the signs of both inputs.
+ */
+int wrapping_add(int a, int b)
+{
+    return static_cast<int>(static_cast<std::uint32_t>(a)
+                            + static_cast<std::uint32_t>(b));
+}
+
+template <OverflowPolicy Policy>
+int add(int a, int b, int& overflow)
+{
+    int const sum = wrapping_add(a, b);
+    int const overflowed = (a ^ sum) & (b ^ sum);
+
+    if (Policy == OverflowPolicy::Saturating && overflowed < 0)
+        return a < 0 ? INT_MIN : INT_MAX;
+    if (Policy == OverflowPolicy::Checked)
+        overflow |= overflowed;
+    return sum;
+}
+
+
+#ifdef EULER67_OVERFLOW_AVX2
+
+/* Fold the longest prefix of the row that is a multiple of eight, eight
+ * values at a time, and return its length. The policies are the same as
+ * the scalar `add` above. AVX2 has no saturating 32-bit add, so saturation
+ * is done by picking INT_MAX or INT_MIN, by the sign of the value, in the
+ * lanes that overflowed.
+ */
+template <typename Rule, OverflowPolicy Policy>
+__attribute__((target("avx2")))
+size_t fold_row_avx2(int* accum, int const* values, size_t size, int& overflow)
+{
+    __m256i flags = _mm256_setzero_si256();
+    __m256i const int_max = _mm256_set1_epi32(INT_MAX);
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i + 1));
+        __m256i const value = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(values + i));
+
+        __m256i const best = Rule::best(left, right);
+        __m256i sum = _mm256_add_epi32(value, best);
+
+        if (Policy != OverflowPolicy::Wrapping)
+        {
+            __m256i const overflowed = _mm256_and_si256(
+                _mm256_xor_si256(value, sum), _mm256_xor_si256(best, sum));
+
+            if (Policy == OverflowPolicy::Saturating)
+            {
+                __m256i const limit = _mm256_xor_si256(
+                    _mm256_srai_epi32(value, 31), int_max);
+                sum = _mm256_blendv_epi8(sum, limit,
+                                         _mm256_srai_epi32(overflowed, 31));
+            }
+            else
+            {
+                flags = _mm256_or_si256(flags, overflowed);
+            }
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i), sum);
+    }
+
+    if (Policy == OverflowPolicy::Checked
+        && _mm256_movemask_ps(_mm256_castsi256_ps(flags)) != 0)
+        overflow |= INT_MIN;
+    return i;
+}
+
+#endif // EULER67_OVERFLOW_AVX2
+
+
+/* Fold a triangle in 32 bits under `Policy`. For the Checked policy, stops
+ * and returns false as soon as a row overflows.
+ */
+template <typename Rule, OverflowPolicy Policy>
+bool fold_32(Triangle const& triangle, int& result)
+{
+    std::vector<int>& accum = thread_workspace<int>().accum(triangle.width());
+    RowView const leaves = triangle.rows().back();
+    accum.assign(leaves.begin(), leaves.end());
+
+#ifdef EULER67_OVERFLOW_AVX2
+    bool const simd = isa_level() >= IsaLevel::Avx2;
+#endif
+
+    for (size_t r = triangle.height() - 1; r-- != 0; )
+    {
+        int const* values = triangle.row(r).data();
+        size_t const size = r + 1;
+        int overflow = 0;
+
+        size_t i = 0;
+#ifdef EULER67_OVERFLOW_AVX2
+        if (simd)
+            i = fold_row_avx2<Rule, Policy>(accum.data(), values, size, overflow);
+#endif
+        for (; i != size; ++i)
+        {
+            accum[i] = add<Policy>(values[i], Rule::best(accum[i], accum[i + 1]),
+                                   overflow);
+        }
+
+        if (overflow < 0)
+            return false;
+    }
+
+    result = accum.front();
+    return true;
+}
+
+template <typename Rule>
+long long fold_64(Triangle const& triangle)
+{
+    return fold_triangle<long long>(triangle,
+        [](int i) -> long long { return i; },
+        [](int i, long long left, long long right) -> long long {
+            return i + Rule::best(left, right);
+        },
+        thread_workspace<long long>());
+}
+
+template <typename Rule>
+long long fold_with_policy(Triangle const& triangle, OverflowPolicy policy)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_with_policy expects a non-empty triangle");
+    }
+
+    int result = 0;
+    switch (policy)
+    {
+    case OverflowPolicy::Wrapping:
+        fold_32<Rule, OverflowPolicy::Wrapping>(triangle, result);
+        return result;
+
+    case OverflowPolicy::Saturating:
+        fold_32<Rule, OverflowPolicy::Saturating>(triangle, result);
+        return result;
+
+    case OverflowPolicy::Checked:
+        if (fold_32<Rule, OverflowPolicy::Checked>(triangle, result))
+            return result;
+        return fold_64<Rule>(triangle);
+    }
+
+    throw std::invalid_argument("unknown OverflowPolicy");
+}
+
+} // namespace
+
+
+long long max_path(Triangle const& triangle, OverflowPolicy policy)
+{
+    return fold_with_policy<MaxPathRule>(triangle, policy);
+}
+
+long long max_odd_even_path(Triangle const& triangle, OverflowPolicy policy)
+{
+    return fold_with_policy<OddEvenPathRule>(triangle, policy);
+}
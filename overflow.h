@@ -0,0 +1,47 @@
+/******************************************************
+ *
+ *  Folds that decide what happens when a path sum
+ *  does not fit in an int.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_OVERFLOW_H
+#define EULER67_OVERFLOW_H
+
+#include "triangle.h"
+
+
+/* `max_path` adds with plain `int` arithmetic, so on a tall triangle with
+ * large values a path sum can overflow, which is undefined behaviour. These
+ * policies make the outcome well defined:
+ *
+ *   Wrapping     sums wrap around modulo 2^32, as unsigned arithmetic does.
+ *                Exactly as fast as `max_path`, and exact whenever no
+ *                partial sum overflows.
+ *
+ *   Saturating   sums stick at INT_MAX (or INT_MIN) instead of wrapping,
+ *                so a saturated result means "at least INT_MAX". For the
+ *                odd/even rule a saturated value's parity is meaningless,
+ *                so there it is only useful to detect that a result is out
+ *                of range.
+ *
+ *   Checked      always gives the exact result. The fold runs in 32 bits
+ *                and ORs together an overflow flag for every addition of a
+ *                row; the flag is tested once per row, and only if it is
+ *                ever set is the whole fold run again in 64 bits.
+ *
+ * Each policy folds eight values at a time with AVX2 where the CPU has it.
+ */
+enum class OverflowPolicy {
+    Wrapping,
+    Saturating,
+    Checked,
+};
+
+long long max_path(Triangle const& triangle, OverflowPolicy policy);
+long long max_odd_even_path(Triangle const& triangle, OverflowPolicy policy);
+
+#endif // EULER67_OVERFLOW_H
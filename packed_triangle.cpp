@@ -0,0 +1,282 @@
+/******************************************************
+ *
+ *  A compressed, bit-packed representation of a
+ *  Triangle for triangles that stay resident.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "packed_triangle.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EULER67_PACKED_AVX2 1
+#endif
+
+
+namespace {
+
+/* Unpacking reads a whole 64-bit word at the byte where a value starts.
+ * These helpers make that word little-endian on any host.
+ */
+std::uint64_t load_le64(unsigned char const* p)
+{
+    std::uint64_t word;
+    std::memcpy(&word, p, sizeof word);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+void store_le64(unsigned char* p, std::uint64_t word)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    std::memcpy(p, &word, sizeof word);
+}
+
+// A value is at most 32 bits wide and starts at most 7 bits into its first
+// byte, so one 64-bit read always covers it.
+size_t const padding_bytes = 8;
+
+unsigned bits_needed(std::uint32_t range)
+{
+    unsigned bits = 0;
+    while (bits < 32 && (range >> bits) != 0)
+        ++bits;
+    return bits;
+}
+
+std::uint32_t unpack(unsigned char const* bytes, unsigned width, size_t n)
+{
+    std::uint64_t const bit = std::uint64_t(n) * width;
+    std::uint64_t const word = load_le64(bytes + bit / 8) >> (bit % 8);
+    return static_cast<std::uint32_t>(word & ((std::uint64_t(1) << width) - 1));
+}
+
+int decode(int base, std::uint32_t offset)
+{
+    // The offset was taken with unsigned arithmetic, so add it back the
+    // same way to get the original value for any range of ints.
+    return static_cast<int>(static_cast<std::uint32_t>(base) + offset);
+}
+
+
+/* The widest values the SIMD kernels can unpack; see below.
+ */
+unsigned const max_simd_width = 25;
+
+
+#ifdef EULER67_PACKED_AVX2
+
+/* The AVX2 kernels unpack and combine eight values at a time.
+ *
+ * For value i of a row, the bit offset from the start of the group is
+ * `first_bit + lane * width`. A gather loads the 32 bits starting at each
+ * value's byte, a per-lane shift drops the bits before the value and a mask
+ * drops the bits after it. This works for any width up to 25 bits, since
+ * the value then fits in 32 bits even when it starts 7 bits into a byte.
+ *
+ * Each kernel processes the longest prefix of the row that is a multiple
+ * of eight and returns its length; the caller finishes the tail.
+ */
+__attribute__((target("avx2")))
+inline __m256i unpack8(unsigned char const* bytes, unsigned width,
+                       size_t i, int base)
+{
+    std::uint64_t const bit = std::uint64_t(i) * width;
+    unsigned char const* group = bytes + bit / 8;
+
+    __m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i const bits = _mm256_add_epi32(
+        _mm256_set1_epi32(static_cast<int>(bit % 8)),
+        _mm256_mullo_epi32(lane, _mm256_set1_epi32(static_cast<int>(width))));
+
+    __m256i const words = _mm256_i32gather_epi32(
+        reinterpret_cast<int const*>(group), _mm256_srli_epi32(bits, 3), 1);
+    __m256i const shifted = _mm256_srlv_epi32(
+        words, _mm256_and_si256(bits, _mm256_set1_epi32(7)));
+    __m256i const mask = _mm256_set1_epi32(
+        static_cast<int>((std::uint32_t(1) << width) - 1));
+
+    return _mm256_add_epi32(_mm256_and_si256(shifted, mask),
+                            _mm256_set1_epi32(base));
+}
+
+__attribute__((target("avx2")))
+size_t max_path_row_avx2(int* accum, unsigned char const* bytes,
+                         unsigned width, int base, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i + 1));
+
+        __m256i const values = unpack8(bytes, width, i, base);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i),
+            _mm256_add_epi32(values, _mm256_max_epi32(left, right)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t odd_even_path_row_avx2(int* accum, unsigned char const* bytes,
+                              unsigned width, int base, size_t size)
+{
+    __m256i const one = _mm256_set1_epi32(1);
+    __m256i const zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i));
+        __m256i const right = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(accum + i + 1));
+
+        // Keep `left` only where it is odd and `right` only where it is
+        // even, exactly as `odd_even_path_combine` does.
+        __m256i const left_odd = _mm256_sub_epi32(
+            zero, _mm256_and_si256(left, one));
+        __m256i const right_even = _mm256_sub_epi32(
+            _mm256_and_si256(right, one), one);
+        __m256i const best = _mm256_max_epi32(
+            _mm256_and_si256(left, left_odd),
+            _mm256_and_si256(right, right_even));
+
+        __m256i const values = unpack8(bytes, width, i, base);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(accum + i),
+            _mm256_add_epi32(values, best));
+    }
+    return i;
+}
+
+#endif // EULER67_PACKED_AVX2
+
+
+using RowKernel = size_t (*)(int*, unsigned char const*, unsigned, int, size_t);
+
+/* The fold over a PackedTriangle. It is the same bottom-up traversal as
+ * `fold_triangle<int>`, except that each row is decoded as it is combined.
+ */
+int fold_packed(PackedTriangle const& triangle,
+                int (*combine)(int, int, int),
+                RowKernel simd_kernel)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_packed expects a non-empty triangle");
+    }
+
+    size_t const bottom = triangle.height() - 1;
+    std::vector<int> accum(triangle.width());
+
+    {
+        auto const& row = triangle.row(bottom);
+        unsigned char const* bytes = triangle.row_bytes(bottom);
+        for (size_t i = 0; i != accum.size(); ++i)
+            accum[i] = decode(row.base, unpack(bytes, row.width, i));
+    }
+
+    for (size_t r = bottom; r-- != 0; )
+    {
+        auto const& row = triangle.row(r);
+        unsigned char const* bytes = triangle.row_bytes(r);
+        size_t const size = r + 1;
+
+        size_t i = 0;
+        if (simd_kernel && row.width <= max_simd_width)
+            i = simd_kernel(accum.data(), bytes, row.width, row.base, size);
+
+        for (; i != size; ++i)
+        {
+            int value = decode(row.base, unpack(bytes, row.width, i));
+            accum[i] = combine(value, accum[i], accum[i + 1]);
+        }
+    }
+
+    return accum.front();
+}
+
+} // namespace
+
+
+PackedTriangle::PackedTriangle(Triangle const& triangle)
+{
+    rows_.reserve(triangle.height());
+
+    std::uint64_t offset = 0;
+    for (RowView row: triangle.rows())
+    {
+        auto const bounds = std::minmax_element(row.begin(), row.end());
+        int const base = *bounds.first;
+        std::uint32_t const range = static_cast<std::uint32_t>(*bounds.second)
+                                  - static_cast<std::uint32_t>(base);
+
+        PackedRow packed;
+        packed.offset = offset;
+        packed.base = base;
+        packed.width = bits_needed(range);
+        rows_.push_back(packed);
+
+        offset += (std::uint64_t(row.size()) * packed.width + 7) / 8;
+    }
+
+    bytes_.assign(offset + padding_bytes, 0);
+
+    for (size_t r = 0; r != rows_.size(); ++r)
+    {
+        PackedRow const& packed = rows_[r];
+        unsigned char* bytes = bytes_.data() + packed.offset;
+
+        RowView const row = triangle.row(r);
+        for (size_t n = 0; n != row.size(); ++n)
+        {
+            std::uint64_t const value = static_cast<std::uint32_t>(row[n])
+                                      - static_cast<std::uint32_t>(packed.base);
+            std::uint64_t const bit = std::uint64_t(n) * packed.width;
+
+            unsigned char* p = bytes + bit / 8;
+            store_le64(p, load_le64(p) | (value << (bit % 8)));
+        }
+    }
+}
+
+int PackedTriangle::at(size_t row, size_t n) const
+{
+    PackedRow const& packed = rows_[row];
+    return decode(packed.base, unpack(row_bytes(row), packed.width, n));
+}
+
+
+int max_path(PackedTriangle const& triangle)
+{
+    RowKernel kernel = nullptr;
+#ifdef EULER67_PACKED_AVX2
+    if (isa_level() >= IsaLevel::Avx2)
+        kernel = max_path_row_avx2;
+#endif
+    return fold_packed(triangle, max_path_combine, kernel);
+}
+
+int max_odd_even_path(PackedTriangle const& triangle)
+{
+    RowKernel kernel = nullptr;
+#ifdef EULER67_PACKED_AVX2
+    if (isa_level() >= IsaLevel::Avx2)
+        kernel = odd_even_path_row_avx2;
+#endif
+    return fold_packed(triangle, odd_even_path_combine, kernel);
+}
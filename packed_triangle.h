@@ -0,0 +1,88 @@
+/******************************************************
+ *
+ *  A compressed, bit-packed representation of a
+ *  Triangle for triangles that stay resident.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_PACKED_TRIANGLE_H
+#define EULER67_PACKED_TRIANGLE_H
+
+#include "triangle.h"
+
+#include <cstdint>
+#include <vector>
+
+
+/* A PackedTriangle holds the same values as a Triangle in far less memory.
+ *
+ * Each row is stored with frame-of-reference encoding: the row's minimum
+ * value is kept as the row's `base`, and every value is stored as its
+ * offset from the base using the fewest bits that can hold the largest
+ * offset in that row. The Project Euler input, for example, needs at most
+ * 7 bits per value instead of 32.
+ *
+ *     row  59                 base 59, width 0 bits
+ *     row  73 41              base 41, width 6 bits  (offsets 32, 0)
+ *     row  52 40 09           base  9, width 6 bits  (offsets 43, 31, 0)
+ *
+ * Rows start on a byte boundary and values are packed little-endian within
+ * a row, so value n of a row starts at bit n * width of the row's bytes.
+ *
+ * A PackedTriangle is immutable. Build one from a Triangle, and solve it
+ * with the `max_path` and `max_odd_even_path` overloads below, which unpack
+ * each row as part of the fold instead of expanding the triangle first.
+ */
+class PackedTriangle {
+public:
+    struct PackedRow {
+        std::uint64_t offset;     // byte offset of the row in `bytes_`
+        int base;                 // smallest value in the row
+        unsigned width;           // bits per value, 0 to 32
+    };
+
+    PackedTriangle() = default;
+    explicit PackedTriangle(Triangle const& triangle);
+
+    size_t height() const { return rows_.size(); }
+    size_t width() const { return height(); }
+
+    PackedRow const& row(size_t r) const { return rows_[r]; }
+    unsigned char const* row_bytes(size_t r) const
+    {
+        return bytes_.data() + rows_[r].offset;
+    }
+
+    /* `at(r,n)` returns the n'th value of the r'th row, with the same
+     * preconditions as `Triangle::at`.
+     */
+    int at(size_t row, size_t n) const;
+
+    /* The number of bytes used by the packed values and row descriptors.
+     */
+    size_t memory_bytes() const
+    {
+        return bytes_.size() + rows_.size() * sizeof(PackedRow);
+    }
+
+private:
+    std::vector<PackedRow> rows_;
+
+    // Followed by a few bytes of padding so that unpacking can always read
+    // a whole machine word, even at the end of the last row.
+    std::vector<unsigned char> bytes_;
+};
+
+
+/* These give the same results as the Triangle versions. The fold unpacks
+ * each row in registers just before it is combined into the accumulator,
+ * so it reads only the packed bytes from memory. Where the CPU supports
+ * AVX2, eight values at a time are unpacked and combined.
+ */
+int max_path(PackedTriangle const& triangle);
+int max_odd_even_path(PackedTriangle const& triangle);
+
+#endif // EULER67_PACKED_TRIANGLE_H
@@ -0,0 +1,655 @@
+/******************************************************
+ *
+ *  A long-running solver that keeps triangles resident
+ *  and answers queries over a Unix domain socket.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <stdexcept>      // std::runtime_error
+#include <utility>        // std::move
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace {
+
+/* Sizes of the frame bodies, i.e. everything after the length prefix.
+ */
+std::size_t const request_body_size  = 4 + 1 + 4 + 4 + 4;
+std::size_t const response_body_size = 4 + 1 + 8;
+
+/* Anything larger than this is not a frame we could ever have sent, so the
+ * connection is dropped rather than buffered.
+ */
+std::uint32_t const max_frame_size = 4096;
+
+
+void put_u32(std::string& out, std::uint32_t v)
+{
+    for (int i = 0; i != 4; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+void put_u64(std::string& out, std::uint64_t v)
+{
+    for (int i = 0; i != 8; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+std::uint32_t get_u32(char const* p)
+{
+    std::uint32_t v = 0;
+    for (int i = 0; i != 4; ++i)
+        v |= std::uint32_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+std::uint64_t get_u64(char const* p)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i != 8; ++i)
+        v |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+void encode_request(std::string& out, Query const& q)
+{
+    put_u32(out, request_body_size);
+    put_u32(out, q.id);
+    out.push_back(static_cast<char>(q.kind));
+    put_u32(out, q.triangle);
+    put_u32(out, q.row);
+    put_u32(out, q.n);
+}
+
+void encode_response(std::string& out, QueryResult const& r)
+{
+    put_u32(out, response_body_size);
+    put_u32(out, r.id);
+    out.push_back(static_cast<char>(r.status));
+    put_u64(out, static_cast<std::uint64_t>(r.value));
+}
+
+bool is_subtriangle(QueryKind kind)
+{
+    return kind == QueryKind::SubMaxPath || kind == QueryKind::SubOddEvenPath;
+}
+
+bool uses_odd_even_rule(QueryKind kind)
+{
+    return kind == QueryKind::OddEvenPath || kind == QueryKind::SubOddEvenPath;
+}
+
+
+/* A path table has the same shape as the Triangle it was computed from.
+ * Each cell holds the value of the best path that starts at that cell,
+ * which is exactly what `fold_triangle` computes for the apex. Keeping
+ * every row instead of a single accumulator means one bottom-up pass
+ * answers every max_path and subtriangle query against a triangle.
+ */
+Triangle path_table(Triangle const& triangle,
+                    std::function<int(int,int,int)> combine)
+{
+    RowRange const rows = triangle.rows();
+    std::vector<Triangle::Row> table(rows.size());
+
+    table.back().assign(rows.back().begin(), rows.back().end());
+    for (size_t r = rows.size() - 1; r-- != 0; )
+    {
+        Triangle::Row const& below = table[r + 1];
+        Triangle::Row& current = table[r];
+
+        current.reserve(r + 1);
+        for (size_t i = 0; i != rows[r].size(); ++i)
+            current.push_back(combine(rows[r][i], below[i], below[i + 1]));
+    }
+
+    Triangle result;
+    for (auto& row: table)
+        result.append_row(std::move(row));
+    return result;
+}
+
+
+struct Connection {
+    int fd;
+    std::string in;       // bytes received but not yet decoded
+    std::string out;      // encoded responses not yet written
+    bool closing = false; // peer hung up or sent garbage
+
+    explicit Connection(int fd) : fd(fd) {}
+};
+
+/* A query together with the connection that is waiting for its answer.
+ */
+struct PendingQuery {
+    size_t connection;
+    Query query;
+    bool malformed;
+};
+
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+    stop_requested = 1;
+}
+
+
+class SolverServer {
+public:
+    explicit SolverServer(std::vector<Triangle> triangles)
+        : triangles_(std::move(triangles)),
+          max_tables_(triangles_.size()),
+          odd_even_tables_(triangles_.size())
+    {
+        for (auto const& triangle: triangles_)
+        {
+            if (triangle.height() == 0)
+                throw std::invalid_argument("the server requires non-empty triangles");
+        }
+    }
+
+    /* Answer a whole batch of queries. All the tables the batch needs are
+     * built up front, so queries that arrive together from many clients
+     * share a single fold per (triangle, rule) pair.
+     */
+    std::vector<QueryResult> answer(std::vector<PendingQuery> const& batch)
+    {
+        for (auto const& pending: batch)
+        {
+            Query const& q = pending.query;
+            if (!pending.malformed && q.triangle < triangles_.size())
+                table_for(q);
+        }
+
+        std::vector<QueryResult> results;
+        results.reserve(batch.size());
+        for (auto const& pending: batch)
+            results.push_back(answer_one(pending));
+        return results;
+    }
+
+private:
+    std::vector<Triangle> triangles_;
+
+    // Tables are computed the first time a triangle is queried and then
+    // stay resident alongside the triangle. An empty table means "not yet".
+    std::vector<Triangle> max_tables_;
+    std::vector<Triangle> odd_even_tables_;
+
+    Triangle const& table_for(Query const& q)
+    {
+        Triangle const& triangle = triangles_[q.triangle];
+
+        if (uses_odd_even_rule(q.kind))
+        {
+            Triangle& table = odd_even_tables_[q.triangle];
+            if (table.height() == 0)
+                table = path_table(triangle, odd_even_path_combine);
+            return table;
+        }
+
+        Triangle& table = max_tables_[q.triangle];
+        if (table.height() == 0)
+            table = path_table(triangle, max_path_combine);
+        return table;
+    }
+
+    QueryResult answer_one(PendingQuery const& pending)
+    {
+        Query const& q = pending.query;
+
+        QueryResult result;
+        result.id = q.id;
+
+        if (pending.malformed)
+        {
+            result.status = QueryStatus::BadRequest;
+            return result;
+        }
+        if (q.triangle >= triangles_.size())
+        {
+            result.status = QueryStatus::NoSuchTriangle;
+            return result;
+        }
+
+        Triangle const& table = table_for(q);
+
+        size_t row = 0;
+        size_t n = 0;
+        if (is_subtriangle(q.kind))
+        {
+            row = q.row;
+            n = q.n;
+            if (row >= table.height() || n > row)
+            {
+                result.status = QueryStatus::OutOfRange;
+                return result;
+            }
+        }
+
+        result.value = table.at(row, n);
+        return result;
+    }
+};
+
+
+/* A socket file left behind by an earlier run would make bind() fail, so
+ * remove it - but only when it is a socket that nobody answers on. Anything
+ * else at the path, including a server that is still running, is reported
+ * as the address being in use.
+ */
+void remove_stale_socket(std::string const& socket_path, sockaddr_un const& addr)
+{
+    struct stat info;
+    if (::lstat(socket_path.c_str(), &info) < 0)
+        return;     // Nothing there; bind() reports any other problem.
+
+    bool stale = false;
+    if (S_ISSOCK(info.st_mode))
+    {
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0)
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        stale = ::connect(probe, reinterpret_cast<sockaddr const*>(&addr),
+                          sizeof addr) < 0 && errno == ECONNREFUSED;
+        ::close(probe);
+    }
+    if (!stale)
+        throw std::runtime_error("cannot listen on " + socket_path
+                                 + ": address in use");
+    ::unlink(socket_path.c_str());
+}
+
+int make_listener(std::string const& socket_path)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof addr.sun_path)
+        throw std::runtime_error("socket path is too long: " + socket_path);
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    remove_stale_socket(socket_path, addr);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0 ||
+        ::listen(fd, SOMAXCONN) < 0)
+    {
+        std::string message = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("cannot listen on " + socket_path + ": "
+                                 + message);
+    }
+    return fd;
+}
+
+/* Read whatever is available on a connection and decode every complete
+ * frame into `batch`. Partial frames stay buffered until the rest arrives.
+ */
+void read_frames(Connection& conn, size_t index,
+                 std::vector<PendingQuery>& batch)
+{
+    char buffer[16384];
+    for (;;)
+    {
+        ssize_t got = ::read(conn.fd, buffer, sizeof buffer);
+        if (got > 0)
+        {
+            conn.in.append(buffer, static_cast<size_t>(got));
+            continue;
+        }
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            conn.closing = true;
+        break;
+    }
+
+    size_t offset = 0;
+    while (conn.in.size() - offset >= 4)
+    {
+        std::uint32_t length = get_u32(conn.in.data() + offset);
+        if (length > max_frame_size)
+        {
+            conn.closing = true;
+            break;
+        }
+        if (conn.in.size() - offset - 4 < length)
+            break;
+
+        char const* body = conn.in.data() + offset + 4;
+
+        PendingQuery pending;
+        pending.connection = index;
+        pending.malformed = length != request_body_size;
+        if (length >= 4)
+            pending.query.id = get_u32(body);
+        if (!pending.malformed)
+        {
+            std::uint8_t kind = static_cast<std::uint8_t>(body[4]);
+            pending.malformed = kind < 1 || kind > 4;
+            pending.query.kind = static_cast<QueryKind>(kind);
+            pending.query.triangle = get_u32(body + 5);
+            pending.query.row = get_u32(body + 9);
+            pending.query.n = get_u32(body + 13);
+        }
+        batch.push_back(pending);
+
+        offset += 4 + length;
+    }
+    conn.in.erase(0, offset);
+}
+
+void write_pending(Connection& conn)
+{
+    while (!conn.out.empty())
+    {
+        ssize_t sent = ::send(conn.fd, conn.out.data(), conn.out.size(),
+                              MSG_NOSIGNAL);
+        if (sent > 0)
+        {
+            conn.out.erase(0, static_cast<size_t>(sent));
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            conn.out.clear();
+            conn.closing = true;
+        }
+        break;
+    }
+}
+
+bool write_all(int fd, std::string const& data)
+{
+    size_t done = 0;
+    while (done != data.size())
+    {
+        ssize_t sent = ::send(fd, data.data() + done, data.size() - done,
+                              MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        done += static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool read_exactly(int fd, char* data, size_t size)
+{
+    size_t done = 0;
+    while (done != size)
+    {
+        ssize_t got = ::read(fd, data + done, size - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+char const* status_name(QueryStatus status)
+{
+    switch (status)
+    {
+    case QueryStatus::Ok:             return "ok";
+    case QueryStatus::BadRequest:     return "bad request";
+    case QueryStatus::NoSuchTriangle: return "no such triangle";
+    case QueryStatus::OutOfRange:     return "out of range";
+    }
+    return "unknown status";
+}
+
+/* The event loop of the server: answer the queries of `connections`, and
+ * of any connection accepted on `listener`, until a signal asks it to stop.
+ * Without a listener (`listener` is -1) it also stops once every
+ * connection has closed. Closes the connections it still has when it stops.
+ */
+void serve(SolverServer& solver, int listener, std::vector<Connection> connections)
+{
+    std::vector<pollfd> fds;
+    std::vector<PendingQuery> batch;
+
+    while (!stop_requested && (listener >= 0 || !connections.empty()))
+    {
+        fds.clear();
+        fds.push_back(pollfd {listener, POLLIN, 0});
+        for (auto const& conn: connections)
+        {
+            // A connection that is closing only waits to send what is left
+            // of its answers; its reads would return end-of-file forever.
+            short events = conn.closing ? 0 : POLLIN;
+            if (!conn.out.empty())
+                events |= POLLOUT;
+            fds.push_back(pollfd {conn.fd, events, 0});
+        }
+
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        // Every frame that arrived during this round, from every client,
+        // is answered as one batch.
+        batch.clear();
+        for (size_t i = 0; i != connections.size(); ++i)
+        {
+            short revents = fds[i + 1].revents;
+            if (!connections[i].closing && (revents & (POLLIN | POLLHUP | POLLERR)))
+                read_frames(connections[i], i, batch);
+            if (revents & POLLOUT)
+                write_pending(connections[i]);
+        }
+
+        std::vector<QueryResult> results = solver.answer(batch);
+        for (size_t i = 0; i != batch.size(); ++i)
+            encode_response(connections[batch[i].connection].out, results[i]);
+
+        for (auto& conn: connections)
+            write_pending(conn);
+
+        // Drop connections that have hung up once their answers are out. A
+        // client that half-closes after a large batch may not have read
+        // them all yet, so its connection stays until `out` drains or a
+        // write fails (which empties `out`).
+        for (size_t i = connections.size(); i-- != 0; )
+        {
+            if (connections[i].closing && connections[i].out.empty())
+            {
+                ::close(connections[i].fd);
+                connections.erase(connections.begin() + i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            for (;;)
+            {
+                int fd = ::accept4(listener, nullptr, nullptr,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                    break;
+                connections.emplace_back(fd);
+            }
+        }
+    }
+
+    for (auto const& conn: connections)
+        ::close(conn.fd);
+}
+
+
+
+} // namespace
+
+
+void run_server(std::string const& socket_path,
+                std::vector<Triangle> triangles)
+{
+    SolverServer solver {std::move(triangles)};
+
+    int listener = make_listener(socket_path);
+
+    stop_requested = 0;
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    serve(solver, listener, std::vector<Connection>());
+
+    ::close(listener);
+    ::unlink(socket_path.c_str());
+}
+
+
+void serve_connection(int fd, std::vector<Triangle> triangles)
+{
+    SolverServer solver {std::move(triangles)};
+
+    int const flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        throw std::runtime_error(std::string("fcntl: ") + std::strerror(errno));
+
+    std::vector<Connection> connections;
+    connections.emplace_back(fd);
+    serve(solver, -1, std::move(connections));
+}
+
+
+bool run_client(std::string const& socket_path,
+                std::vector<Query> const& queries,
+                std::ostream& out)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof addr.sun_path)
+        throw std::runtime_error("socket path is too long: " + socket_path);
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0)
+    {
+        std::string message = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("cannot connect to " + socket_path + ": "
+                                 + message);
+    }
+
+    // Every request goes out before we wait for the first answer.
+    std::string frames;
+    for (auto const& q: queries)
+        encode_request(frames, q);
+
+    bool connected = write_all(fd, frames);
+    bool ok = connected;
+
+    char frame[4 + response_body_size];
+    for (size_t i = 0; connected && i != queries.size(); ++i)
+    {
+        if (!read_exactly(fd, frame, sizeof frame) ||
+            get_u32(frame) != response_body_size)
+        {
+            ok = connected = false;
+            break;
+        }
+
+        QueryResult result;
+        result.id = get_u32(frame + 4);
+        result.status = static_cast<QueryStatus>(frame[8]);
+        result.value = static_cast<std::int64_t>(get_u64(frame + 9));
+
+        out << "#" << result.id << ": ";
+        if (result.status == QueryStatus::Ok)
+            out << result.value << "\n";
+        else
+        {
+            out << status_name(result.status) << "\n";
+            ok = false;
+        }
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+
+Query parse_query_spec(std::string const& spec)
+{
+    std::vector<std::string> fields;
+    std::istringstream stream {spec};
+    std::string field;
+    while (std::getline(stream, field, ':'))
+        fields.push_back(field);
+
+    if (fields.size() != 2 && fields.size() != 4)
+    {
+        throw std::invalid_argument(
+            "query must be RULE:TRIANGLE or RULE:TRIANGLE:ROW:N: " + spec);
+    }
+
+    bool odd_even;
+    if (fields[0] == "max")
+        odd_even = false;
+    else if (fields[0] == "oddeven")
+        odd_even = true;
+    else
+        throw std::invalid_argument("unknown query rule: " + fields[0]);
+
+    auto number = [&spec](std::string const& s) -> std::uint32_t {
+        if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+            throw std::invalid_argument("bad number in query: " + spec);
+        std::uint64_t value = 0;
+        for (char c: s)
+        {
+            value = value * 10 + static_cast<unsigned>(c - '0');
+            if (value > UINT32_MAX)
+                throw std::invalid_argument("number out of range in query: " + spec);
+        }
+        return static_cast<std::uint32_t>(value);
+    };
+
+    Query q;
+    q.triangle = number(fields[1]);
+    if (fields.size() == 4)
+    {
+        q.kind = odd_even ? QueryKind::SubOddEvenPath : QueryKind::SubMaxPath;
+        q.row = number(fields[2]);
+        q.n = number(fields[3]);
+    }
+    else
+    {
+        q.kind = odd_even ? QueryKind::OddEvenPath : QueryKind::MaxPath;
+    }
+    return q;
+}
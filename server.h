@@ -0,0 +1,95 @@
+/******************************************************
+ *
+ *  A long-running solver that keeps triangles resident
+ *  and answers queries over a Unix domain socket.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_SERVER_H
+#define EULER67_SERVER_H
+
+#include "triangle.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* The wire protocol is a sequence of length-prefixed frames. Every integer
+ * is encoded little-endian, independent of the host.
+ *
+ *   request  := u32 length, u32 id, u8 kind, u32 triangle, u32 row, u32 n
+ *   response := u32 length, u32 id, u8 status, i64 value
+ *
+ * `length` counts the bytes that follow it. `id` is chosen by the client
+ * and echoed back so that a client may pipeline many requests on one
+ * connection; responses on a connection are sent in request order.
+ *
+ * `triangle` is the index of a triangle in the order the server loaded them.
+ * `row` and `n` are only meaningful for the subtriangle queries, which ask
+ * for the best path starting at `triangle.at(row, n)` instead of the apex.
+ */
+enum class QueryKind : std::uint8_t {
+    MaxPath        = 1,
+    OddEvenPath    = 2,
+    SubMaxPath     = 3,
+    SubOddEvenPath = 4,
+};
+
+enum class QueryStatus : std::uint8_t {
+    Ok             = 0,
+    BadRequest     = 1,
+    NoSuchTriangle = 2,
+    OutOfRange     = 3,
+};
+
+struct Query {
+    std::uint32_t id       = 0;
+    QueryKind     kind     = QueryKind::MaxPath;
+    std::uint32_t triangle = 0;
+    std::uint32_t row      = 0;
+    std::uint32_t n        = 0;
+};
+
+struct QueryResult {
+    std::uint32_t id     = 0;
+    QueryStatus   status = QueryStatus::Ok;
+    std::int64_t  value  = 0;
+};
+
+
+/* Serve queries against `triangles` on a Unix socket bound at `socket_path`
+ * until the process receives SIGINT or SIGTERM. The socket file is removed
+ * on exit. Throws std::runtime_error if the socket cannot be set up.
+ */
+void run_server(std::string const& socket_path,
+                std::vector<Triangle> triangles);
+
+/* Serve queries against `triangles` on `fd`, a connection that is already
+ * open (one end of a socketpair(), say), until the peer has closed it and
+ * every answer has been sent. Takes ownership of `fd`.
+ */
+void serve_connection(int fd, std::vector<Triangle> triangles);
+
+/* Connect to a server, send all of `queries` at once (pipelined) and write
+ * one line per response to `out`. Returns false if any query failed.
+ */
+bool run_client(std::string const& socket_path,
+                std::vector<Query> const& queries,
+                std::ostream& out);
+
+/* Parse a query given on the command line, of the form
+ *
+ *     max:TRIANGLE  or  oddeven:TRIANGLE
+ *     max:TRIANGLE:ROW:N  or  oddeven:TRIANGLE:ROW:N   (subtriangles)
+ *
+ * Throws std::invalid_argument if the spec is malformed, or if a number
+ * does not fit in the 32 bits of its field.
+ */
+Query parse_query_spec(std::string const& spec);
+
+#endif // EULER67_SERVER_H
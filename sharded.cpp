@@ -0,0 +1,388 @@
+/******************************************************
+ *
+ *  Solving large batches of triangles with a pool of
+ *  worker processes that share one memory segment.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "sharded.h"
+#include "triangle_file.h"
+
+#include <algorithm>      // std::min
+#include <atomic>
+#include <functional>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>            // placement new
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+namespace {
+
+/* The segment is shared between processes, so the atomics in it must not
+ * depend on any per-process state. Lock-free atomics are address-free.
+ */
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "the shared claim index needs lock-free atomics");
+
+/* The layout of the segment:
+ *
+ *     SegmentHeader
+ *     ResultSlot[count]
+ *     std::uint64_t pending[count]
+ *     the triangles, each in the binary triangle format, 8-byte aligned
+ *
+ * `pending` lists the slots the workers of the current round are to solve:
+ * every slot in the first round, and in later rounds the ones left over by
+ * workers that crashed.
+ *
+ * The coordinator and the workers are the same program, forked from one
+ * process, so the header and slots use the native layout.
+ */
+struct SegmentHeader {
+    std::atomic<std::uint64_t> next_pending;    // the claim index
+    std::uint64_t pending_count;
+    std::uint64_t shard_size;
+};
+
+enum SlotState : std::uint32_t {
+    Unclaimed = 0,
+    Claimed   = 1,
+    Solved    = 2,
+    Failed    = 3,
+};
+
+struct ResultSlot {
+    std::atomic<std::uint32_t> state;
+    std::uint64_t offset;         // of the triangle, from the segment start
+    std::uint64_t size;           // of the triangle, in bytes
+    std::uint64_t height;
+    std::int32_t max_path;
+    std::int32_t max_odd_even_path;
+    char error[112];              // set when `state` is Failed
+};
+
+std::uint64_t align8(std::uint64_t n)
+{
+    return (n + 7) / 8 * 8;
+}
+
+
+/* A POSIX shared memory segment, mapped into this process. The name is
+ * unlinked as soon as the segment is mapped: the workers inherit the
+ * mapping when they are forked, so nothing is left behind in /dev/shm even
+ * if the coordinator is killed.
+ */
+class SharedSegment {
+public:
+    explicit SharedSegment(std::uint64_t size)
+        : base_(nullptr), size_(size)
+    {
+        static std::atomic<unsigned> serial {0};
+        std::string const name = "/euler67-" + std::to_string(::getpid())
+                               + "-" + std::to_string(serial++);
+
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0)
+            throw std::runtime_error(std::string("shm_open failed: ")
+                                     + std::strerror(errno));
+        ::shm_unlink(name.c_str());
+
+        void* base = MAP_FAILED;
+        if (::ftruncate(fd, static_cast<off_t>(size_)) == 0)
+            base = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        int const error = errno;
+        ::close(fd);
+
+        if (base == MAP_FAILED)
+            throw std::runtime_error(
+                std::string("failed to map shared memory: ")
+                + std::strerror(error));
+        base_ = static_cast<unsigned char*>(base);
+    }
+
+    ~SharedSegment()
+    {
+        ::munmap(base_, size_);
+    }
+
+    SharedSegment(SharedSegment const&) = delete;
+    SharedSegment& operator=(SharedSegment const&) = delete;
+
+    unsigned char* data() const { return base_; }
+
+private:
+    unsigned char* base_;
+    std::uint64_t size_;
+};
+
+
+void fail_slot(ResultSlot& slot, char const* message)
+{
+    std::strncpy(slot.error, message, sizeof slot.error - 1);
+    slot.error[sizeof slot.error - 1] = '\0';
+    slot.state.store(Failed, std::memory_order_release);
+}
+
+/* `fold_triangle<int>` over rows that are not in a Triangle.
+ */
+int fold_rows(RowRange const& rows, std::function<int(int,int,int)> const& combine_t)
+{
+    if (rows.size() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle expects a non-empty triangle");
+    }
+
+    std::vector<int>& accum = thread_workspace<int>().accum(rows.size());
+    RowView const bottom = rows.back();
+    accum.assign(bottom.begin(), bottom.end());
+
+    for (size_t r = rows.size() - 1; r-- != 0; )
+    {
+        RowView const row = rows[r];
+        fold_row<int>(accum, row.data(), row.size(), combine_t);
+    }
+    return accum.front();
+}
+
+/* Solve the triangle of `slot` where it lies in the segment. Its values
+ * are little-endian, so on a little-endian host the rows are read in place
+ * and a worker never holds a copy of a triangle; elsewhere each triangle
+ * is decoded first.
+ */
+void solve_slot(unsigned char const* segment, ResultSlot& slot)
+{
+    try {
+        unsigned char const* bytes = segment + slot.offset;
+        std::uint64_t const height = decode_binary_header(bytes);
+        if (binary_row_offset(height) > slot.size)
+            throw std::runtime_error("truncated binary triangle");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        RowRange const rows {
+            reinterpret_cast<int const*>(bytes + binary_header_size),
+            static_cast<size_t>(height) };
+#else
+        Triangle const triangle = decode_binary_triangle(bytes, slot.size);
+        RowRange const rows = triangle.rows();
+#endif
+
+        slot.height = height;
+        slot.max_path = fold_rows(rows, max_path_combine);
+        slot.max_odd_even_path = fold_rows(rows, odd_even_path_combine);
+        slot.state.store(Solved, std::memory_order_release);
+    }
+    catch (std::exception const& e) {
+        fail_slot(slot, e.what());
+    }
+}
+
+/* The body of a worker process: claim shards of the pending slots until
+ * there are none left. `attempts` counts the crashed attempts at each slot.
+ */
+void run_worker(unsigned char* segment, ResultSlot* slots,
+                std::uint64_t const* pending, unsigned const* attempts,
+                ShardedOptions const& options)
+{
+    auto& header = *reinterpret_cast<SegmentHeader*>(segment);
+
+    for (;;)
+    {
+        std::uint64_t const first = header.next_pending.fetch_add(
+            header.shard_size, std::memory_order_relaxed);
+        if (first >= header.pending_count)
+            return;
+
+        std::uint64_t const last =
+            std::min(first + header.shard_size, header.pending_count);
+        for (std::uint64_t i = first; i != last; ++i)
+        {
+            std::uint64_t const index = pending[i];
+            slots[index].state.store(Claimed, std::memory_order_relaxed);
+            if (options.before_solve)
+                options.before_solve(static_cast<size_t>(index), attempts[index]);
+            solve_slot(segment, slots[index]);
+        }
+    }
+}
+
+/* Fork `workers` workers to solve the pending slots, and wait for all of
+ * them. Returns the number started, and sets `fork_error` if fewer were.
+ * The workers exit with _exit() so that they never run the coordinator's
+ * destructors or flush its buffered output.
+ */
+unsigned run_round(unsigned char* segment, ResultSlot* slots,
+                   std::uint64_t const* pending, unsigned const* attempts,
+                   ShardedOptions const& options, unsigned workers,
+                   int& fork_error)
+{
+    std::vector<pid_t> started;
+    for (unsigned i = 0; i != workers; ++i)
+    {
+        pid_t const pid = ::fork();
+        if (pid == 0)
+        {
+            int status = 0;
+            try {
+                run_worker(segment, slots, pending, attempts, options);
+            }
+            catch (...) {
+                status = 1;
+            }
+            ::_exit(status);
+        }
+        if (pid < 0)
+        {
+            fork_error = errno;
+            break;
+        }
+        started.push_back(pid);
+    }
+
+    for (pid_t pid: started)
+    {
+        while (::waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+            ;
+    }
+    return static_cast<unsigned>(started.size());
+}
+
+} // namespace
+
+
+std::vector<ShardedResult> solve_sharded(std::vector<Triangle> const& triangles,
+                                         ShardedOptions const& options)
+{
+    std::uint64_t const count = triangles.size();
+    std::vector<ShardedResult> results(count);
+    if (count == 0)
+        return results;
+
+    // Lay out the segment: the header, the slots, the pending list, then
+    // the triangles.
+    std::uint64_t const slots_offset = sizeof(SegmentHeader);
+    std::uint64_t const pending_offset =
+        align8(slots_offset + count * sizeof(ResultSlot));
+    std::uint64_t size = pending_offset + count * sizeof(std::uint64_t);
+
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(count);
+    for (auto const& triangle: triangles)
+    {
+        offsets.push_back(size);
+        size += align8(binary_row_offset(triangle.height()));
+    }
+
+    SharedSegment segment {size};
+    unsigned char* const base = segment.data();
+
+    auto* header = new (base) SegmentHeader;
+    header->shard_size = std::max(1u, options.shard_size);
+
+    auto* slots = reinterpret_cast<ResultSlot*>(base + slots_offset);
+    auto* pending = reinterpret_cast<std::uint64_t*>(base + pending_offset);
+    for (std::uint64_t i = 0; i != count; ++i)
+    {
+        ResultSlot* slot = new (&slots[i]) ResultSlot;
+        slot->state.store(Unclaimed, std::memory_order_relaxed);
+        slot->offset = offsets[i];
+        slot->size = binary_row_offset(triangles[i].height());
+        slot->error[0] = '\0';
+
+        encode_binary_triangle(triangles[i], base + offsets[i]);
+    }
+
+    // Run rounds of workers until every slot is solved or failed. A crashed
+    // worker leaves the rest of its shard Unclaimed, and those slots are
+    // simply handed to the next round. The slot it was solving is left
+    // Claimed; it is tried once more, in case the crash had some other
+    // cause, and after that reported as an error rather than crashing
+    // worker after worker. A round in which no worker got as far as
+    // claiming a slot (none could be forked, or all were killed at once)
+    // ends the batch.
+    unsigned const workers = std::max(1u, options.workers);
+    unsigned const attempts_allowed = 2;
+    std::vector<unsigned> attempts(count, 0);
+
+    std::uint64_t pending_count = 0;
+    for (std::uint64_t i = 0; i != count; ++i)
+        pending[pending_count++] = i;
+
+    bool any_started = false;
+    int fork_error = 0;
+    while (pending_count != 0)
+    {
+        header->next_pending.store(0, std::memory_order_relaxed);
+        header->pending_count = pending_count;
+
+        unsigned const started = run_round(base, slots, pending,
+            attempts.data(), options,
+            static_cast<unsigned>(std::min<std::uint64_t>(workers, pending_count)),
+            fork_error);
+        any_started = any_started || started != 0;
+
+        // Every worker of the round has exited, so its slots are final.
+        std::uint64_t left = 0;
+        bool progress = false;
+        for (std::uint64_t j = 0; j != pending_count; ++j)
+        {
+            std::uint64_t const i = pending[j];
+            std::uint32_t const state = slots[i].state.load(std::memory_order_acquire);
+            if (state == Claimed)
+                ++attempts[i];
+            progress = progress || state != Unclaimed;
+
+            if (state == Unclaimed ||
+                (state == Claimed && attempts[i] < attempts_allowed))
+            {
+                slots[i].state.store(Unclaimed, std::memory_order_relaxed);
+                pending[left++] = i;
+            }
+        }
+        pending_count = left;
+
+        if (!progress)
+            break;
+    }
+
+    if (!any_started)
+        throw std::runtime_error(std::string("failed to start a worker: ")
+                                 + std::strerror(fork_error));
+
+    for (std::uint64_t i = 0; i != count; ++i)
+    {
+        ResultSlot const& slot = slots[i];
+        ShardedResult& result = results[i];
+
+        switch (slot.state.load(std::memory_order_acquire))
+        {
+        case Solved:
+            result.solved.height = slot.height;
+            result.solved.max_path = slot.max_path;
+            result.solved.max_odd_even_path = slot.max_odd_even_path;
+            break;
+        case Failed:
+            result.error = slot.error;
+            break;
+        case Claimed:
+            result.error = "worker exited while solving this triangle";
+            break;
+        default:
+            result.error = "no worker claimed this triangle";
+            break;
+        }
+    }
+
+    return results;
+}
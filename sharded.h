@@ -0,0 +1,68 @@
+/******************************************************
+ *
+ *  Solving large batches of triangles with a pool of
+ *  worker processes that share one memory segment.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_SHARDED_H
+#define EULER67_SHARDED_H
+
+#include "triangle.h"
+#include "cache.h"        // SolvedTriangle
+
+#include <string>
+#include <vector>
+
+
+/* The result for one triangle of the batch, or the reason it could not be
+ * solved.
+ */
+struct ShardedResult {
+    SolvedTriangle solved;
+    std::string error;       // empty on success
+};
+
+struct ShardedOptions {
+    // The number of worker processes forked by the coordinator.
+    unsigned workers = 4;
+
+    // The number of consecutive triangles a worker claims at once. Larger
+    // shards mean fewer trips to the shared claim index.
+    unsigned shard_size = 1;
+
+    // If set, a worker calls this before it solves each triangle, with the
+    // triangle's index in `triangles` and the number of earlier attempts at
+    // it that crashed. For tests, which use it to crash workers.
+    void (*before_solve)(size_t index, unsigned crashed_attempts) = nullptr;
+};
+
+/* Solve every triangle in `triangles` with a pool of worker processes.
+ *
+ * The calling process is the coordinator. It creates a POSIX shared memory
+ * segment and writes every triangle into it in the binary triangle format
+ * (see triangle_file.h), followed by a table of result slots. It then forks
+ * `options.workers` workers, which inherit the mapping.
+ *
+ * Each worker repeatedly claims the next shard by incrementing an atomic
+ * index in the segment, solves the triangles in it straight out of the
+ * segment, without copying them, and writes their results into their
+ * slots. No locks are taken: every slot is written by exactly one worker,
+ * and the coordinator only reads the slots after every worker has exited.
+ *
+ * If a worker crashes, the coordinator forks new workers for the rest of
+ * its shard. The triangle it was solving is tried once more, and if that
+ * crashes too it is reported as an error instead of bringing down the
+ * batch.
+ *
+ * Results are returned in the order of `triangles`. Throws
+ * std::runtime_error if the segment cannot be created or no worker can be
+ * started.
+ */
+std::vector<ShardedResult> solve_sharded(std::vector<Triangle> const& triangles,
+                                         ShardedOptions const& options = ShardedOptions());
+
+#endif // EULER67_SHARDED_H
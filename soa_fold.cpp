@@ -0,0 +1,134 @@
+/******************************************************
+ *
+ *  A fold whose results have more than one field, with
+ *  each field kept in its own array.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "soa_fold.h"
+#include "dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EULER67_SOA_X86 1
+#endif
+
+
+namespace {
+
+size_t path_count_row_scalar(int*, std::uint64_t*, int const*, size_t)
+{
+    return 0;
+}
+
+#ifdef EULER67_SOA_X86
+
+/* The sums are 32 bits and the path counts 64, so each vector of sums
+ * goes with two vectors of counts, and the comparisons of the sums are
+ * widened to select the counts.
+ *
+ * A count is kept where its result below is at least as great as the
+ * other one, that is, where the other one is not greater.
+ */
+__attribute__((target("avx2")))
+size_t path_count_row_avx2(int* max_paths, std::uint64_t* paths,
+                           int const* values, size_t size)
+{
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i const left = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(max_paths + i));
+        __m256i const right = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(max_paths + i + 1));
+        __m256i const value = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(values + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(max_paths + i),
+                            _mm256_add_epi32(value, _mm256_max_epi32(left, right)));
+
+        __m256i const left_less = _mm256_cmpgt_epi32(right, left);
+        __m256i const right_less = _mm256_cmpgt_epi32(left, right);
+
+        for (size_t half = 0; half != 2; ++half)
+        {
+            size_t const j = i + 4 * half;
+            __m256i const drop_left = _mm256_cvtepi32_epi64(half == 0
+                ? _mm256_castsi256_si128(left_less)
+                : _mm256_extracti128_si256(left_less, 1));
+            __m256i const drop_right = _mm256_cvtepi32_epi64(half == 0
+                ? _mm256_castsi256_si128(right_less)
+                : _mm256_extracti128_si256(right_less, 1));
+
+            __m256i const left_paths = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(paths + j));
+            __m256i const right_paths = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(paths + j + 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(paths + j),
+                                _mm256_add_epi64(_mm256_andnot_si256(drop_left, left_paths),
+                                                 _mm256_andnot_si256(drop_right, right_paths)));
+        }
+    }
+    return i;
+}
+
+/* With mask registers the whole row is folded, the last part under a
+ * mask, as in the AVX-512 kernels of dispatch.cpp. The unmasked operations
+ * are written as `maskz` ones for the same reason.
+ */
+__attribute__((target("avx512f")))
+size_t path_count_row_avx512(int* max_paths, std::uint64_t* paths,
+                             int const* values, size_t size)
+{
+    for (size_t i = 0; i < size; i += 16)
+    {
+        size_t const remaining = size - i;
+        __mmask16 const mask = remaining >= 16 ? __mmask16(0xFFFF)
+                                               : __mmask16((1u << remaining) - 1);
+
+        __m512i const left = _mm512_maskz_loadu_epi32(mask, max_paths + i);
+        __m512i const right = _mm512_maskz_loadu_epi32(mask, max_paths + i + 1);
+        __m512i const value = _mm512_maskz_loadu_epi32(mask, values + i);
+        _mm512_mask_storeu_epi32(max_paths + i, mask,
+                                 _mm512_add_epi32(value, _mm512_maskz_max_epi32(mask, left, right)));
+
+        __mmask16 const keep_left = _mm512_mask_cmpge_epi32_mask(mask, left, right);
+        __mmask16 const keep_right = _mm512_mask_cmpge_epi32_mask(mask, right, left);
+
+        for (size_t half = 0; half != 2; ++half)
+        {
+            size_t const j = i + 8 * half;
+            __mmask8 const lanes = __mmask8(mask >> (8 * half));
+            __mmask8 const left_lanes = __mmask8(keep_left >> (8 * half));
+            __mmask8 const right_lanes = __mmask8(keep_right >> (8 * half));
+
+            __m512i const left_paths = _mm512_maskz_loadu_epi64(left_lanes, paths + j);
+            __m512i const right_paths = _mm512_maskz_loadu_epi64(right_lanes, paths + j + 1);
+            _mm512_mask_storeu_epi64(paths + j, lanes,
+                                     _mm512_maskz_add_epi64(lanes, left_paths, right_paths));
+        }
+    }
+    return size;
+}
+
+#endif // EULER67_SOA_X86
+
+} // namespace
+
+
+PathCountRule::PathCountRule()
+    : row_(path_count_row_scalar)
+{
+#ifdef EULER67_SOA_X86
+    if (isa_level() >= IsaLevel::Avx512)
+        row_ = path_count_row_avx512;
+    else if (isa_level() >= IsaLevel::Avx2)
+        row_ = path_count_row_avx2;
+#endif
+}
+
+PathCount max_path_count(Triangle const& triangle)
+{
+    static thread_local SoaAccumulator<PathCountRule::State> accum;
+
+    PathCountRule::State const result =
+        fold_triangle_soa(triangle, PathCountRule(), accum);
+    return PathCount { std::get<0>(result), std::get<1>(result) };
+}
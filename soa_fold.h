@@ -0,0 +1,206 @@
+/******************************************************
+ *
+ *  A fold whose results have more than one field, with
+ *  each field kept in its own array.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_SOA_FOLD_H
+#define EULER67_SOA_FOLD_H
+
+#include "triangle.h"
+
+#include <cstdint>
+#include <tuple>
+#include <utility>        // std::index_sequence
+
+
+/* `fold_triangle<T>` keeps its results in a `std::vector<T>`. When T is a
+ * struct, its fields are interleaved in memory, so a row cannot be folded
+ * with one vector load per field, and the fold runs one result at a time.
+ *
+ * A SoaAccumulator keeps the results of a fold whose result is a
+ * `std::tuple<Fields...>` as one array per field instead, so that a rule
+ * can fold a row with SIMD loads, stores and arithmetic on every field.
+ * Like a FoldWorkspace, it can be reused between folds.
+ */
+template <typename State>
+class SoaAccumulator;
+
+template <typename... Fields>
+class SoaAccumulator<std::tuple<Fields...>> {
+    std::tuple<std::vector<Fields>...> arrays_;
+
+    template <size_t... N>
+    void resize(size_t width, std::index_sequence<N...>)
+    {
+        (void)std::initializer_list<int> {
+            (std::get<N>(arrays_).resize(width), 0)... };
+    }
+
+    template <size_t... N>
+    std::tuple<Fields*...> data(std::index_sequence<N...>)
+    {
+        return std::tuple<Fields*...> { std::get<N>(arrays_).data()... };
+    }
+
+    template <size_t... N>
+    std::tuple<Fields...> get(size_t i, std::index_sequence<N...>) const
+    {
+        return std::tuple<Fields...> { std::get<N>(arrays_)[i]... };
+    }
+
+    template <size_t... N>
+    void set(size_t i, std::tuple<Fields...> const& value,
+             std::index_sequence<N...>)
+    {
+        (void)std::initializer_list<int> {
+            (std::get<N>(arrays_)[i] = std::get<N>(value), 0)... };
+    }
+
+public:
+    using Indices = std::index_sequence_for<Fields...>;
+
+    /* Make room for `width` results. The storage only ever grows.
+     */
+    void reset(size_t width) { resize(width, Indices()); }
+
+    /* The first element of every array, for a rule's row kernel.
+     */
+    std::tuple<Fields*...> data() { return data(Indices()); }
+
+    std::tuple<Fields...> get(size_t i) const { return get(i, Indices()); }
+
+    void set(size_t i, std::tuple<Fields...> const& value)
+    {
+        set(i, value, Indices());
+    }
+};
+
+
+/* fold_triangle_soa<Rule>(triangle, rule, accum)
+ *     - the same fold as `fold_triangle<typename Rule::State>`, with the
+ *       results kept in `accum`, one array per field.
+ *
+ * `Rule` describes the fold:
+ *
+ *     using State = std::tuple<Fields...>;
+ *
+ *     // The same as the `make_t` and `combine_t` of `fold_triangle`.
+ *     State leaf(int value) const;
+ *     State combine(int value, State const& left, State const& right) const;
+ *
+ *     // Fold the first results of a row of `size` values in place, on
+ *     // every field at once, and return how many it folded. The rest of
+ *     // the row is folded with `combine`, so a rule without SIMD code
+ *     // just returns 0.
+ *     size_t fold_row(std::tuple<Fields*...> accum,
+ *                     int const* values, size_t size) const;
+ *
+ * As in `fold_row`, each result only depends on the results at its own
+ * position and the next one, so `fold_row` may store results i..i+k-1
+ * before it loads results i+k onwards.
+ */
+template <typename Rule>
+typename Rule::State fold_triangle_soa(Triangle const& triangle, Rule const& rule,
+                                       SoaAccumulator<typename Rule::State>& accum)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle_soa expects a non-empty triangle");
+    }
+
+    accum.reset(triangle.width());
+
+    RowView const bottom = triangle.rows().back();
+    for (size_t i = 0; i != bottom.size(); ++i)
+        accum.set(i, rule.leaf(bottom[i]));
+
+    auto const arrays = accum.data();
+    for (size_t r = triangle.height() - 1; r-- != 0; )
+    {
+        RowView const row = triangle.row(r);
+
+        size_t i = rule.fold_row(arrays, row.data(), row.size());
+        for (; i != row.size(); ++i)
+            accum.set(i, rule.combine(row[i], accum.get(i), accum.get(i + 1)));
+    }
+    return accum.get(0);
+}
+
+
+/* The maximum path value, as `max_path` finds it, together with the number
+ * of paths that reach it. The number of paths doubles with every row of a
+ * triangle of equal values, so it is counted modulo 2^64.
+ */
+struct PathCount {
+    int max_path;
+    std::uint64_t paths;
+};
+
+/* The best result below is the greater of the two, and its paths are the
+ * paths of every result below that is as great.
+ */
+inline PathCount path_count_combine(int i, PathCount left, PathCount right)
+{
+    return PathCount {
+        max_path_combine(i, left.max_path, right.max_path),
+        (left.max_path >= right.max_path ? left.paths : 0) +
+        (right.max_path >= left.max_path ? right.paths : 0)
+    };
+}
+
+/* The same fold as a rule for `fold_triangle_soa`, whose row kernel folds
+ * 8 (AVX2) or 16 (AVX-512) results at a time where the CPU has them.
+ * The kernel is chosen once, when the rule is constructed.
+ */
+class PathCountRule {
+public:
+    using State = std::tuple<int, std::uint64_t>;
+
+    PathCountRule();
+
+    State leaf(int value) const
+    {
+        return State { value, 1 };
+    }
+
+    State combine(int value, State const& left, State const& right) const
+    {
+        PathCount const result = path_count_combine(value,
+            PathCount { std::get<0>(left), std::get<1>(left) },
+            PathCount { std::get<0>(right), std::get<1>(right) });
+        return State { result.max_path, result.paths };
+    }
+
+    size_t fold_row(std::tuple<int*, std::uint64_t*> accum,
+                    int const* values, size_t size) const
+    {
+        return row_(std::get<0>(accum), std::get<1>(accum), values, size);
+    }
+
+private:
+    size_t (*row_)(int* max_paths, std::uint64_t* paths,
+                   int const* values, size_t size);
+};
+
+/* max_path_count(triangle)
+ *     - the maximum path value and the number of paths that reach it,
+ *       folded with `PathCountRule`.
+ *
+ * max_path_count_aos(triangle)
+ *     - the same, folded by `fold_triangle<PathCount>`, for comparison.
+ */
+PathCount max_path_count(Triangle const& triangle);
+
+inline PathCount max_path_count_aos(Triangle const& triangle)
+{
+    auto leaf = [](int i) -> PathCount { return PathCount { i, 1 }; };
+    return fold_triangle<PathCount>(triangle, leaf, path_count_combine,
+                                    thread_workspace<PathCount>());
+}
+
+#endif // EULER67_SOA_FOLD_H
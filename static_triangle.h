@@ -0,0 +1,163 @@
+/******************************************************
+ *
+ *  A Triangle whose height is fixed at compile time,
+ *  with a fold that is unrolled row by row.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_STATIC_TRIANGLE_H
+#define EULER67_STATIC_TRIANGLE_H
+
+#include "triangle.h"
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>        // std::index_sequence
+
+
+/* A StaticTriangle<N> has exactly N rows, stored in one std::array. It is
+ * meant for services that solve huge numbers of triangles of one common
+ * shape (such as the 100 rows of Problem 67), where the per-call cost
+ * matters more than flexibility:
+ *
+ *   - there is no heap allocation, neither for the values nor for the
+ *     accumulator of the fold, which lives on the stack;
+ *   - the fold below is unrolled over the rows, so every row length is a
+ *     compile-time constant and the compiler can fully unroll and
+ *     vectorize each row.
+ *
+ * Since the height is part of the type, the row-length invariant holds by
+ * construction and there is no `append_row`.
+ */
+template <size_t N>
+class StaticTriangle {
+    static_assert(N > 0, "a StaticTriangle must have at least one row");
+
+public:
+    static constexpr size_t cell_count = N * (N + 1) / 2;
+    using Cells = std::array<int, cell_count>;
+
+private:
+    Cells cells_;
+
+    static constexpr size_t row_start(size_t row)
+    {
+        return row * (row + 1) / 2;
+    }
+
+public:
+    constexpr StaticTriangle()
+        : cells_{}
+    {
+    }
+
+    /* Build from all of the values, listed row by row from the top.
+     */
+    constexpr explicit StaticTriangle(Cells const& cells)
+        : cells_(cells)
+    {
+    }
+
+    /* Copy a Triangle, which must have exactly N rows.
+     */
+    explicit StaticTriangle(Triangle const& triangle)
+        : cells_{}
+    {
+        if (triangle.height() != N)
+        {
+            throw std::invalid_argument(
+                "StaticTriangle<N> requires a triangle with N rows");
+        }
+
+        size_t i = 0;
+        for (RowView row: triangle.rows())
+            for (int value: row)
+                cells_[i++] = value;
+    }
+
+    static constexpr size_t height() { return N; }
+    static constexpr size_t width() { return N; }
+
+    /* `at(r,n)` returns the n'th value of the r'th row, with the same
+     * preconditions as `Triangle::at`.
+     */
+    constexpr int at(size_t row, size_t n) const { return cells_[row_start(row) + n]; }
+    int& at(size_t row, size_t n) { return cells_[row_start(row) + n]; }
+
+    /* Pointer to the first value of a row, which has `r + 1` values.
+     */
+    constexpr int const* row(size_t r) const { return cells_.data() + row_start(r); }
+};
+
+
+namespace static_fold {
+
+/* Fold row `Row` into the accumulator. `Row` is a template parameter, so
+ * the trip count of the loop is a constant.
+ */
+template <size_t Row, typename T, size_t N, typename Combine>
+constexpr void fold_static_row(T* accum, StaticTriangle<N> const& triangle,
+                        Combine const& combine_t)
+{
+    for (size_t i = 0; i != Row + 1; ++i)
+    {
+        accum[i] = combine_t(triangle.at(Row, i), accum[i], accum[i + 1]);
+    }
+}
+
+/* `Steps` counts up from 0 while the rows are folded from N - 2 up to 0.
+ * The expansion into an array initializer is evaluated left to right, so
+ * the rows are folded in order, one call per row with no loop around them.
+ */
+template <typename T, size_t N, typename Make, typename Combine,
+          size_t... Steps>
+constexpr T fold(StaticTriangle<N> const& triangle,
+                 Make const& make_t, Combine const& combine_t,
+                 std::index_sequence<Steps...>)
+{
+    T accum[N] {};
+
+    for (size_t i = 0; i != N; ++i)
+    {
+        accum[i] = make_t(triangle.at(N - 1, i));
+    }
+
+    using expand = int[];
+    (void)expand { 0, (fold_static_row<N - 2 - Steps>(accum, triangle, combine_t), 0)... };
+
+    return accum[0];
+}
+
+} // namespace static_fold
+
+
+/* fold_triangle<T>(static_triangle, make_t, combine_t)
+ *
+ * The same bottom-up fold as `fold_triangle<T>` on a Triangle, with the
+ * loop over the rows unrolled at compile time.
+ */
+template <typename T, size_t N, typename Make, typename Combine>
+constexpr T fold_triangle(StaticTriangle<N> const& triangle,
+                          Make make_t, Combine combine_t)
+{
+    return static_fold::fold<T>(triangle, make_t, combine_t,
+                                std::make_index_sequence<N - 1>());
+}
+
+template <size_t N>
+constexpr int max_path(StaticTriangle<N> const& triangle)
+{
+    return fold_triangle<int>(triangle, LeafValue(), MaxPathCombine());
+}
+
+template <size_t N>
+constexpr int max_odd_even_path(StaticTriangle<N> const& triangle)
+{
+    return fold_triangle<int>(triangle, LeafValue(), OddEvenPathCombine());
+}
+
+#endif // EULER67_STATIC_TRIANGLE_H
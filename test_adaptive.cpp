@@ -0,0 +1,158 @@
+/******************************************************
+ *
+ *  Checks that max_path_adaptive is exact, and that it
+ *  widens its accumulator when it must and never
+ *  narrows it again.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "adaptive.h"
+#include "dispatch.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+long long max_path_64(Triangle const& triangle)
+{
+    return fold_triangle<long long>(triangle,
+        [](int i) -> long long { return i; },
+        [](int i, long long left, long long right) -> long long {
+            return i + std::max(left, right);
+        });
+}
+
+/* The narrowest precision that holds `value`.
+ */
+Precision precision_of(long long value)
+{
+    if (value >= std::numeric_limits<std::int16_t>::min()
+        && value <= std::numeric_limits<std::int16_t>::max())
+        return Precision::Int16;
+    if (value >= INT_MIN && value <= INT_MAX)
+        return Precision::Int32;
+    return Precision::Int64;
+}
+
+/* A triangle of `height` rows that all hold `value`, except the rows in
+ * `special`, which hold `special_value`.
+ */
+Triangle layered_triangle(size_t height, int value,
+                          std::vector<size_t> const& special, int special_value)
+{
+    Triangle triangle;
+    for (size_t r = 0; r != height; ++r)
+    {
+        bool const is_special =
+            std::find(special.begin(), special.end(), r) != special.end();
+        triangle.append_row(Triangle::Row(r + 1, is_special ? special_value : value));
+    }
+    return triangle;
+}
+
+void check_exact(Triangle const& triangle, std::string const& what)
+{
+    long long const expected = max_path_64(triangle);
+    for (size_t block_rows: { 1, 7, 64 })
+    {
+        AdaptiveResult const result = max_path_adaptive(triangle, block_rows);
+        std::string const where = what + ", blocks of "
+                                  + std::to_string(block_rows);
+
+        expect(result.max_path == expected, "max_path_adaptive, " + where);
+        expect(result.precision >= precision_of(expected),
+               "precision holds the result, " + where);
+    }
+}
+
+} // namespace
+
+
+int main()
+{
+    std::cout << "test_adaptive: " << isa_name(isa_level()) << " kernels\n";
+
+    std::mt19937 random {42};
+    std::uniform_int_distribution<size_t> height {1, 200};
+
+    struct Values { int low, high; char const* name; };
+    std::vector<Values> const ranges {
+        { 0, 99, "small values" },
+        { -99, 99, "small values of either sign" },
+        { 0, 30000, "values that fit in 16 bits" },
+        { -1000000, 1000000, "values of a million" },
+        { 0, INT_MAX, "values up to INT_MAX" },
+        { INT_MIN, INT_MAX, "values of any size" },
+    };
+
+    for (auto const& range: ranges)
+    {
+        for (int i = 0; i != 50; ++i)
+        {
+            Triangle const triangle =
+                random_triangle(random, height(random), range.low, range.high);
+            check_exact(triangle, std::string(range.name) + ", height "
+                                  + std::to_string(triangle.height()));
+        }
+    }
+
+    // Sums that fit in 16 bits with room to spare stay in 16 bits.
+    for (int i = 0; i != 50; ++i)
+    {
+        Triangle const triangle = random_triangle(random, height(random), 0, 99);
+        expect(max_path_adaptive(triangle).precision == Precision::Int16,
+               "small values stay in 16 bits");
+    }
+
+    // A value that does not fit in 16 bits widens the accumulator, even
+    // where the sums would.
+    {
+        Triangle const triangle = layered_triangle(100, 0, { 50 }, 40000);
+        check_exact(triangle, "one row of 40000");
+        expect(max_path_adaptive(triangle, 64).precision == Precision::Int32,
+               "a row of 40000 widens to 32 bits");
+    }
+
+    // Two rows of 20000 in the middle of a block, after blocks of zeros
+    // that gave no warning, overflow 16 bits: the block is undone and
+    // folded again in 32 bits.
+    {
+        Triangle const triangle = layered_triangle(200, 0, { 60, 61 }, 20000);
+        AdaptiveResult const result = max_path_adaptive(triangle, 64);
+        expect(result.max_path == 40000, "undoing an overflowed block");
+        expect(result.precision == Precision::Int32,
+               "an overflowed block widens to 32 bits");
+    }
+
+    // Rows of 10^9 above small values widen straight through to 64 bits.
+    {
+        Triangle const triangle = layered_triangle(200, 1, { 10, 11, 12 }, 1000000000);
+        check_exact(triangle, "rows of 10^9");
+        expect(max_path_adaptive(triangle).precision == Precision::Int64,
+               "rows of 10^9 widen to 64 bits");
+    }
+
+    // Once widened the accumulator is never narrowed, even when the result
+    // fits in 16 bits again.
+    {
+        Triangle const triangle = layered_triangle(40, -1000, { 39 }, 40000);
+        AdaptiveResult const result = max_path_adaptive(triangle, 4);
+        expect(result.max_path == 1000, "a result back within 16 bits");
+        expect(result.precision == Precision::Int32,
+               "the accumulator is not narrowed again");
+    }
+
+    return test_result("test_adaptive");
+}
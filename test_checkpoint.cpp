@@ -0,0 +1,157 @@
+/******************************************************
+ *
+ *  Checks that the out-of-core fold only resumes from
+ *  a checkpoint of the triangle it is folding, and how
+ *  it reports checkpoints that cannot be written.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "triangle_file.h"
+#include "checkpoint.h"
+#include "test_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+
+namespace {
+
+Triangle make_triangle(size_t height, int seed)
+{
+    Triangle triangle;
+    for (size_t r = 0; r != height; ++r)
+    {
+        Triangle::Row row(r + 1);
+        for (size_t i = 0; i <= r; ++i)
+            row[i] = static_cast<int>((r * 31 + i * 17 + seed * 7) % 100);
+        triangle.append_row(std::move(row));
+    }
+    return triangle;
+}
+
+void write_file(std::string const& path, Triangle const& triangle)
+{
+    std::ofstream out {path, std::ios::binary};
+    write_binary_triangle(out, triangle);
+}
+
+/* Save the checkpoint the fold of `path` would have saved after its bottom
+ * row, which is just that row.
+ */
+void save_bottom_row(std::string const& path, Triangle const& triangle,
+                     std::string const& checkpoint_path)
+{
+    ReverseRowReader reader {path};
+
+    Checkpoint checkpoint;
+    checkpoint.value_size = sizeof(int);
+    checkpoint.height = reader.height();
+    checkpoint.row = reader.height() - 1;
+    checkpoint.source = reader.identity();
+
+    RowView const bottom = triangle.rows().back();
+    checkpoint.accum.resize(bottom.size() * sizeof(int));
+    std::memcpy(checkpoint.accum.data(), bottom.data(), checkpoint.accum.size());
+
+    CheckpointWriter writer {checkpoint_path};
+    writer.submit(checkpoint);
+    writer.finish();
+}
+
+int fold(std::string const& path, std::string const& checkpoint_path)
+{
+    OutOfCoreOptions options;
+    options.checkpoint_path = checkpoint_path;
+    return fold_triangle_file<int>(path,
+        [](int i) -> int { return i; }, max_path_combine, options);
+}
+
+} // namespace
+
+
+int main()
+{
+    std::string const prefix = "/tmp/euler67_test_" + std::to_string(::getpid());
+    std::string const first_path = prefix + "_first.bin";
+    std::string const second_path = prefix + "_second.bin";
+    std::string const checkpoint_path = prefix + ".max";
+
+    Triangle const first = make_triangle(50, 1);
+    Triangle const second = make_triangle(50, 2);
+    write_file(first_path, first);
+    write_file(second_path, second);
+
+    // A checkpoint of the same file resumes, and gives the same answer.
+    save_bottom_row(first_path, first, checkpoint_path);
+    expect(fold(first_path, checkpoint_path) == max_path(first),
+           "resuming a checkpoint of the same triangle");
+
+    // A checkpoint of another triangle of the same height is refused.
+    save_bottom_row(first_path, first, checkpoint_path);
+    bool refused = false;
+    try {
+        fold(second_path, checkpoint_path);
+    }
+    catch (std::runtime_error const&) {
+        refused = true;
+    }
+    expect(refused, "resuming a checkpoint of another triangle");
+
+    // So is one of the same path, once the file has been rewritten.
+    ::usleep(10000);
+    write_file(first_path, second);
+    refused = false;
+    try {
+        fold(first_path, checkpoint_path);
+    }
+    catch (std::runtime_error const&) {
+        refused = true;
+    }
+    expect(refused, "resuming a checkpoint of a rewritten file");
+
+    // A failed write is reported by a later submit...
+    std::string const unwritable_path = prefix + "_missing/checkpoint.max";
+    bool reported = false;
+    {
+        CheckpointWriter writer {unwritable_path};
+        for (int attempt = 0; attempt != 1000 && !reported; ++attempt)
+        {
+            try {
+                writer.submit(Checkpoint());
+            }
+            catch (std::runtime_error const&) {
+                reported = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    expect(reported, "reporting a failed checkpoint write at the next submit");
+
+    // ...but not by finish(), which runs once the answer is already known.
+    bool finished = true;
+    try {
+        CheckpointWriter writer {unwritable_path};
+        writer.submit(Checkpoint());
+        writer.finish();
+    }
+    catch (...) {
+        finished = false;
+    }
+    expect(finished, "finishing after a failed checkpoint write");
+
+    std::remove(first_path.c_str());
+    std::remove(second_path.c_str());
+    std::remove(checkpoint_path.c_str());
+
+    return test_result("test_checkpoint");
+}
@@ -0,0 +1,109 @@
+/******************************************************
+ *
+ *  Checks the fold kernels of every instruction set
+ *  level this CPU supports against the scalar folds.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "dispatch.h"
+#include "test_util.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+/* The whole fold, done one row at a time with a row kernel.
+ */
+int fold_with_row_kernel(Triangle const& triangle,
+                         void (*row_kernel)(int*, int const*, size_t))
+{
+    RowView const bottom = triangle.row(triangle.height() - 1);
+    std::vector<int> accum(bottom.begin(), bottom.end());
+
+    for (size_t r = triangle.height() - 1; r-- != 0; )
+        row_kernel(accum.data(), triangle.row(r).data(), r + 1);
+    return accum.front();
+}
+
+void check_level(IsaLevel level, std::vector<Triangle> const& triangles)
+{
+    FoldKernels const& kernels = fold_kernels(level);
+    std::string const name = isa_name(level);
+
+    std::vector<Triangle const*> batch;
+    std::vector<int> max_paths;
+    std::vector<int> odd_even_paths;
+
+    for (size_t i = 0; i != triangles.size(); ++i)
+    {
+        Triangle const& triangle = triangles[i];
+        int const max = max_path(triangle);
+        int const odd_even = max_odd_even_path(triangle);
+        std::string const what = name + ", triangle " + std::to_string(i)
+            + " of height " + std::to_string(triangle.height());
+
+        expect(kernels.max_path(triangle) == max, "max_path, " + what);
+        expect(kernels.odd_even_path(triangle) == odd_even,
+               "odd_even_path, " + what);
+        expect(fold_with_row_kernel(triangle, kernels.max_path_row) == max,
+               "max_path_row, " + what);
+        expect(fold_with_row_kernel(triangle, kernels.odd_even_path_row) == odd_even,
+               "odd_even_path_row, " + what);
+
+        batch.push_back(&triangle);
+        max_paths.push_back(max);
+        odd_even_paths.push_back(odd_even);
+    }
+
+    std::vector<int> batch_max(batch.size());
+    std::vector<int> batch_odd_even(batch.size());
+    kernels.solve_batch(batch.data(), batch.size(),
+                        batch_max.data(), batch_odd_even.data());
+    expect(batch_max == max_paths, "solve_batch max paths, " + name);
+    expect(batch_odd_even == odd_even_paths, "solve_batch odd/even paths, " + name);
+}
+
+} // namespace
+
+
+int main()
+{
+    // Heights from 1 to 200 cover every row tail length of every vector
+    // width, and the short rows the AVX-512 kernels keep in a register.
+    // A third of the triangles have negative and large values.
+    std::mt19937 random {67};
+    std::uniform_int_distribution<size_t> height {1, 200};
+
+    std::vector<Triangle> triangles;
+    for (int i = 0; i != 600; ++i)
+    {
+        if (i % 3 == 2)
+            triangles.push_back(random_triangle(random, height(random), -1000000, 1000000));
+        else
+            triangles.push_back(random_triangle(random, height(random), 0, 99));
+    }
+
+    IsaLevel const best = detected_isa_level();
+    for (IsaLevel level: { IsaLevel::Scalar, IsaLevel::Sse42,
+                           IsaLevel::Avx2, IsaLevel::Avx512 })
+    {
+        if (level <= best)
+            check_level(level, triangles);
+    }
+
+    for (auto const& triangle: triangles)
+    {
+        expect(max_path_simd(triangle) == max_path(triangle), "max_path_simd");
+        expect(max_odd_even_path_simd(triangle) == max_odd_even_path(triangle),
+               "max_odd_even_path_simd");
+    }
+
+    return test_result("test_dispatch");
+}
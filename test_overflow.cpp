@@ -0,0 +1,130 @@
+/******************************************************
+ *
+ *  Checks the overflow policies of overflow.h against
+ *  64-bit folds that apply each policy one addition
+ *  at a time.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "overflow.h"
+#include "dispatch.h"
+#include "test_util.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+long long max_best(long long left, long long right)
+{
+    return std::max(left, right);
+}
+
+long long odd_even_best(long long left, long long right)
+{
+    return std::max(left % 2 == 0 ? 0 : left,
+                    right % 2 == 0 ? right : 0);
+}
+
+/* What each policy makes of an exact 64-bit sum of two ints.
+ */
+long long exact(long long sum)
+{
+    return sum;
+}
+
+long long wrapped(long long sum)
+{
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(sum));
+}
+
+long long saturated(long long sum)
+{
+    return std::min<long long>(std::max<long long>(sum, INT_MIN), INT_MAX);
+}
+
+/* The fold of `triangle` in 64 bits, with every addition passed through
+ * `policy`.
+ */
+long long reference(Triangle const& triangle,
+                    long long (*best)(long long, long long),
+                    long long (*policy)(long long))
+{
+    return fold_triangle<long long>(triangle,
+        [](int i) -> long long { return i; },
+        [=](int i, long long left, long long right) -> long long {
+            return policy(i + best(left, right));
+        });
+}
+
+void check(Triangle const& triangle, std::string const& what)
+{
+    long long const max = reference(triangle, max_best, exact);
+    long long const odd_even = reference(triangle, odd_even_best, exact);
+
+    expect(max_path(triangle, OverflowPolicy::Checked) == max,
+           "checked max_path, " + what);
+    expect(max_odd_even_path(triangle, OverflowPolicy::Checked) == odd_even,
+           "checked max_odd_even_path, " + what);
+
+    expect(max_path(triangle, OverflowPolicy::Wrapping)
+               == reference(triangle, max_best, wrapped),
+           "wrapping max_path, " + what);
+    expect(max_odd_even_path(triangle, OverflowPolicy::Wrapping)
+               == reference(triangle, odd_even_best, wrapped),
+           "wrapping max_odd_even_path, " + what);
+
+    expect(max_path(triangle, OverflowPolicy::Saturating)
+               == reference(triangle, max_best, saturated),
+           "saturating max_path, " + what);
+    expect(max_odd_even_path(triangle, OverflowPolicy::Saturating)
+               == reference(triangle, odd_even_best, saturated),
+           "saturating max_odd_even_path, " + what);
+}
+
+} // namespace
+
+
+int main()
+{
+    std::cout << "test_overflow: " << isa_name(isa_level()) << " kernels\n";
+
+    // Heights up to 200 cover the row tails of the eight-wide kernels.
+    // Values up to 2^30 overflow a few rows up from the bottom, and values
+    // near INT_MAX and INT_MIN overflow on the first addition, in both
+    // directions.
+    std::mt19937 random {41};
+    std::uniform_int_distribution<size_t> height {1, 200};
+
+    struct Values { int low, high; char const* name; };
+    std::vector<Values> const ranges {
+        { 0, 99, "small values" },
+        { -1000000, 1000000, "values of a million" },
+        { 0, 1 << 30, "values up to 2^30" },
+        { -(1 << 30), 1 << 30, "values of 2^30 of either sign" },
+        { INT_MAX - 100, INT_MAX, "values near INT_MAX" },
+        { INT_MIN, INT_MIN + 100, "values near INT_MIN" },
+    };
+
+    for (auto const& range: ranges)
+    {
+        for (int i = 0; i != 100; ++i)
+        {
+            Triangle const triangle =
+                random_triangle(random, height(random), range.low, range.high);
+            check(triangle, std::string(range.name) + ", height "
+                            + std::to_string(triangle.height()));
+        }
+    }
+
+    return test_result("test_overflow");
+}
@@ -0,0 +1,250 @@
+/******************************************************
+ *
+ *  Checks the server's wire protocol over a socketpair,
+ *  and the parsing of command-line queries.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "server.h"
+#include "test_util.h"
+
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+namespace {
+
+/* The frames are encoded here from the description in server.h, rather
+ * than with the server's own encoder, so that the test checks the protocol
+ * as documented.
+ */
+void put_u32(std::string& out, std::uint32_t v)
+{
+    for (int i = 0; i != 4; ++i)
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+std::uint64_t get_le(char const* p, int bytes)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i != bytes; ++i)
+        v |= std::uint64_t(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+void put_request(std::string& out, Query const& q)
+{
+    put_u32(out, 17);
+    put_u32(out, q.id);
+    out.push_back(static_cast<char>(q.kind));
+    put_u32(out, q.triangle);
+    put_u32(out, q.row);
+    put_u32(out, q.n);
+}
+
+Query make_query(std::uint32_t id, QueryKind kind, std::uint32_t triangle,
+                 std::uint32_t row = 0, std::uint32_t n = 0)
+{
+    Query q;
+    q.id = id;
+    q.kind = kind;
+    q.triangle = triangle;
+    q.row = row;
+    q.n = n;
+    return q;
+}
+
+/* The subtriangle whose apex is `triangle.at(row, n)`.
+ */
+Triangle subtriangle(Triangle const& triangle, size_t row, size_t n)
+{
+    Triangle sub;
+    for (size_t r = row; r != triangle.height(); ++r)
+    {
+        RowView const values = triangle.row(r);
+        sub.append_row(Triangle::Row(values.begin() + n,
+                                     values.begin() + n + (r - row) + 1));
+    }
+    return sub;
+}
+
+struct Expected {
+    QueryStatus status;
+    std::int64_t value;
+};
+
+Expected answer(std::vector<Triangle> const& triangles, Query const& q)
+{
+    if (q.triangle >= triangles.size())
+        return Expected { QueryStatus::NoSuchTriangle, 0 };
+    Triangle const& triangle = triangles[q.triangle];
+
+    switch (q.kind)
+    {
+    case QueryKind::MaxPath:
+        return Expected { QueryStatus::Ok, max_path(triangle) };
+    case QueryKind::OddEvenPath:
+        return Expected { QueryStatus::Ok, max_odd_even_path(triangle) };
+    default:
+        break;
+    }
+
+    if (q.row >= triangle.height() || q.n > q.row)
+        return Expected { QueryStatus::OutOfRange, 0 };
+
+    Triangle const sub = subtriangle(triangle, q.row, q.n);
+    if (q.kind == QueryKind::SubMaxPath)
+        return Expected { QueryStatus::Ok, max_path(sub) };
+    return Expected { QueryStatus::Ok, max_odd_even_path(sub) };
+}
+
+void test_protocol()
+{
+    std::mt19937 random {26};
+    std::vector<Triangle> triangles;
+    triangles.push_back(random_triangle(random, 100, 0, 99));
+    triangles.push_back(random_triangle(random, 37, 0, 99));
+
+    std::vector<Query> queries;
+    std::uint32_t id = 1000;
+    for (std::uint32_t t = 0; t != triangles.size(); ++t)
+    {
+        std::uint32_t const height = static_cast<std::uint32_t>(triangles[t].height());
+        queries.push_back(make_query(id++, QueryKind::MaxPath, t));
+        queries.push_back(make_query(id++, QueryKind::OddEvenPath, t));
+        for (std::uint32_t row = 0; row < height; row += 9)
+        {
+            for (std::uint32_t n = 0; n <= row; n += 4)
+            {
+                queries.push_back(make_query(id++, QueryKind::SubMaxPath, t, row, n));
+                queries.push_back(make_query(id++, QueryKind::SubOddEvenPath, t, row, n));
+            }
+        }
+        queries.push_back(make_query(id++, QueryKind::SubMaxPath, t, height, 0));
+        queries.push_back(make_query(id++, QueryKind::SubOddEvenPath, t, 3, 4));
+    }
+    queries.push_back(make_query(id++, QueryKind::MaxPath, 2));
+    queries.push_back(make_query(id++, QueryKind::SubOddEvenPath, 4000000000u, 0, 0));
+
+    // Every request is sent before any answer is read, then the client
+    // half-closes: the server must still send every answer, in order.
+    int fds[2];
+    expect(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair");
+    std::thread server {serve_connection, fds[1], triangles};
+
+    std::string requests;
+    for (auto const& q: queries)
+        put_request(requests, q);
+
+    // A frame of the wrong length is answered as a bad request.
+    put_u32(requests, 5);
+    put_u32(requests, id);
+    requests.push_back(static_cast<char>(QueryKind::MaxPath));
+
+    std::thread writer {[&] {
+        for (size_t sent = 0; sent != requests.size(); )
+        {
+            ssize_t n = ::write(fds[0], requests.data() + sent, requests.size() - sent);
+            if (n <= 0)
+                break;
+            sent += static_cast<size_t>(n);
+        }
+        ::shutdown(fds[0], SHUT_WR);
+    }};
+
+    std::string responses;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = ::read(fds[0], buffer, sizeof buffer)) > 0)
+        responses.append(buffer, static_cast<size_t>(got));
+
+    writer.join();
+    server.join();
+    ::close(fds[0]);
+
+    size_t const frame_size = 4 + 13;
+    expect(responses.size() == (queries.size() + 1) * frame_size,
+           "one response per request");
+    if (responses.size() != (queries.size() + 1) * frame_size)
+        return;
+
+    for (size_t i = 0; i != queries.size(); ++i)
+    {
+        char const* frame = responses.data() + i * frame_size;
+        Query const& q = queries[i];
+        Expected const expected = answer(triangles, q);
+        std::string const what = "query #" + std::to_string(q.id);
+
+        expect(get_le(frame, 4) == 13, "response length, " + what);
+        expect(get_le(frame + 4, 4) == q.id, "response id, " + what);
+        expect(static_cast<QueryStatus>(frame[8]) == expected.status,
+               "response status, " + what);
+        if (expected.status == QueryStatus::Ok)
+        {
+            expect(static_cast<std::int64_t>(get_le(frame + 9, 8)) == expected.value,
+                   "response value, " + what);
+        }
+    }
+
+    char const* last = responses.data() + queries.size() * frame_size;
+    expect(get_le(last + 4, 4) == id, "id of a malformed request");
+    expect(static_cast<QueryStatus>(last[8]) == QueryStatus::BadRequest,
+           "a malformed request is a bad request");
+}
+
+bool rejects(std::string const& spec)
+{
+    try {
+        parse_query_spec(spec);
+    }
+    catch (std::invalid_argument const&) {
+        return true;
+    }
+    return false;
+}
+
+void test_query_specs()
+{
+    Query q = parse_query_spec("max:3");
+    expect(q.kind == QueryKind::MaxPath && q.triangle == 3, "max:3");
+
+    q = parse_query_spec("oddeven:0");
+    expect(q.kind == QueryKind::OddEvenPath && q.triangle == 0, "oddeven:0");
+
+    q = parse_query_spec("max:1:20:7");
+    expect(q.kind == QueryKind::SubMaxPath && q.triangle == 1
+           && q.row == 20 && q.n == 7, "max:1:20:7");
+
+    q = parse_query_spec("oddeven:0:4294967295:0");
+    expect(q.kind == QueryKind::SubOddEvenPath && q.row == 4294967295u,
+           "oddeven:0:4294967295:0");
+
+    expect(rejects("max:4294967296"), "a triangle index over 32 bits");
+    expect(rejects("max:0:18446744073709551617:0"), "a row over 64 bits");
+    expect(rejects("max:0:0:99999999999"), "an n over 32 bits");
+    expect(rejects("min:0"), "an unknown rule");
+    expect(rejects("max:-1"), "a negative number");
+    expect(rejects("max:"), "a missing number");
+    expect(rejects("max:0:1"), "a subtriangle without n");
+}
+
+} // namespace
+
+
+int main()
+{
+    test_protocol();
+    test_query_specs();
+    return test_result("test_server");
+}
@@ -0,0 +1,104 @@
+/******************************************************
+ *
+ *  Checks that solve_sharded gives the answers of the
+ *  in-process folds used by `--batch`, including when
+ *  workers crash.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "sharded.h"
+#include "dispatch.h"
+#include "test_util.h"
+
+#include <csignal>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+
+namespace {
+
+/* Crash the worker on its first attempt at every fifth triangle, and on
+ * every attempt at triangle 7.
+ */
+void crash_some(size_t index, unsigned crashed_attempts)
+{
+    if ((index % 5 == 0 && crashed_attempts == 0) || index == 7)
+        ::kill(::getpid(), SIGKILL);
+}
+
+void check(std::vector<Triangle> const& triangles, ShardedOptions const& options,
+           std::string const& what)
+{
+    std::vector<ShardedResult> const results = solve_sharded(triangles, options);
+    expect(results.size() == triangles.size(), "one result per triangle, " + what);
+    if (results.size() != triangles.size())
+        return;
+
+    for (size_t i = 0; i != triangles.size(); ++i)
+    {
+        ShardedResult const& result = results[i];
+        std::string const where = what + ", triangle " + std::to_string(i);
+
+        if (options.before_solve && i == 7)
+        {
+            expect(result.error == "worker exited while solving this triangle",
+                   "a triangle that always crashes is reported, " + where);
+            continue;
+        }
+
+        Triangle const& triangle = triangles[i];
+        if (triangle.height() == 0)
+        {
+            expect(result.error == "fold_triangle expects a non-empty triangle",
+                   "an empty triangle is reported, " + where);
+            continue;
+        }
+
+        expect(result.error.empty(), "no error, " + where);
+        expect(result.solved.height == triangle.height(), "height, " + where);
+        expect(result.solved.max_path == max_path_simd(triangle),
+               "max path, " + where);
+        expect(result.solved.max_odd_even_path == max_odd_even_path_simd(triangle),
+               "odd/even path, " + where);
+    }
+}
+
+} // namespace
+
+
+int main()
+{
+    std::mt19937 random {37};
+    std::uniform_int_distribution<size_t> height {1, 150};
+
+    std::vector<Triangle> triangles;
+    for (int i = 0; i != 60; ++i)
+        triangles.push_back(random_triangle(random, height(random), 0, 99));
+    triangles[23] = Triangle();
+
+    for (unsigned shard_size: { 1, 4 })
+    {
+        ShardedOptions options;
+        options.workers = 3;
+        options.shard_size = shard_size;
+        std::string const what = "shards of " + std::to_string(shard_size);
+
+        check(triangles, options, what);
+
+        // A crashed worker's shard is handed to new workers, and the
+        // triangle it was solving is tried once more.
+        options.before_solve = crash_some;
+        check(triangles, options, what + ", with crashes");
+    }
+
+    expect(solve_sharded(std::vector<Triangle>()).empty(), "an empty batch");
+
+    return test_result("test_sharded");
+}
@@ -0,0 +1,80 @@
+/******************************************************
+ *
+ *  Checks the path-count kernels of soa_fold.h against
+ *  the same fold through fold_triangle<PathCount>.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "triangle.h"
+#include "soa_fold.h"
+#include "dispatch.h"
+#include "test_util.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+void check(Triangle const& triangle, std::string const& what)
+{
+    PathCount const expected = max_path_count_aos(triangle);
+    PathCount const result = max_path_count(triangle);
+
+    expect(expected.max_path == max_path(triangle),
+           "max_path_count_aos finds max_path, " + what);
+    expect(result.max_path == expected.max_path,
+           "max_path_count max_path, " + what);
+    expect(result.paths == expected.paths, "max_path_count paths, " + what);
+}
+
+} // namespace
+
+
+int main()
+{
+    std::cout << "test_soa_fold: " << isa_name(isa_level()) << " kernels\n";
+
+    // Heights up to 200 cover the row tails of the 8- and 16-wide kernels.
+    // Values of 0 and 1 make many paths tie, so the counts add up.
+    std::mt19937 random {50};
+    std::uniform_int_distribution<size_t> height {1, 200};
+
+    struct Values { int low, high; char const* name; };
+    std::vector<Values> const ranges {
+        { 0, 1, "values of 0 and 1" },
+        { 0, 9, "values up to 9" },
+        { 0, 99, "values up to 99" },
+        { -1000000, 1000000, "values of a million" },
+    };
+
+    for (auto const& range: ranges)
+    {
+        for (int i = 0; i != 150; ++i)
+        {
+            Triangle const triangle =
+                random_triangle(random, height(random), range.low, range.high);
+            check(triangle, std::string(range.name) + ", height "
+                            + std::to_string(triangle.height()));
+        }
+    }
+
+    // In a triangle of equal values every one of the 2^(height - 1) paths
+    // is a maximum one, counted modulo 2^64.
+    for (size_t h = 1; h <= 100; ++h)
+    {
+        Triangle const triangle = random_triangle(random, h, 5, 5);
+        std::uint64_t const paths = h - 1 < 64 ? std::uint64_t(1) << (h - 1) : 0;
+        std::string const what = "equal values, height " + std::to_string(h);
+
+        check(triangle, what);
+        expect(max_path_count(triangle).paths == paths, "all paths counted, " + what);
+    }
+
+    return test_result("test_soa_fold");
+}
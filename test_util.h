@@ -0,0 +1,68 @@
+/******************************************************
+ *
+ *  The few helpers shared by the test programs run
+ *  by `make check`.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_TEST_UTIL_H
+#define EULER67_TEST_UTIL_H
+
+#include "triangle.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+
+/* `expect(ok, what)` records a failed check without stopping the test, so
+ * that one run reports every check that fails. `test_result(name)` prints
+ * the outcome and returns the exit status for `main`.
+ */
+inline int& test_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void expect(bool ok, std::string const& what)
+{
+    if (!ok)
+    {
+        std::cerr << "FAILED: " << what << "\n";
+        ++test_failures();
+    }
+}
+
+inline int test_result(char const* name)
+{
+    if (test_failures() == 0)
+        std::cout << name << ": all checks passed\n";
+    else
+        std::cout << name << ": " << test_failures() << " check(s) failed\n";
+    return test_failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* A triangle of `height` rows of values drawn uniformly from [low, high].
+ */
+inline Triangle random_triangle(std::mt19937& random, size_t height,
+                                int low, int high)
+{
+    std::uniform_int_distribution<int> value {low, high};
+
+    Triangle triangle;
+    for (size_t r = 0; r != height; ++r)
+    {
+        Triangle::Row row(r + 1);
+        for (int& v: row)
+            v = value(random);
+        triangle.append_row(std::move(row));
+    }
+    return triangle;
+}
+
+#endif // EULER67_TEST_UTIL_H
@@ -0,0 +1,83 @@
+/******************************************************
+ *
+ *  Message passing between the workers of a fold that
+ *  is split across several machines.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#include "transport.h"
+
+#include <stdexcept>
+
+
+class LoopbackNetwork::Endpoint : public Transport {
+public:
+    Endpoint(LoopbackNetwork& network, unsigned rank)
+        : network_(network), rank_(rank)
+    {
+    }
+
+    unsigned rank() const override { return rank_; }
+    unsigned size() const override { return network_.size(); }
+
+    void send(unsigned to, Message message) override
+    {
+        network_.deliver(rank_, to, std::move(message));
+    }
+
+    Message receive(unsigned from) override
+    {
+        return network_.take(from, rank_);
+    }
+
+private:
+    LoopbackNetwork& network_;
+    unsigned rank_;
+};
+
+
+LoopbackNetwork::LoopbackNetwork(unsigned size)
+    : channels_(size_t(size) * size)
+{
+    if (size == 0)
+        throw std::invalid_argument("LoopbackNetwork needs at least one worker");
+
+    for (unsigned rank = 0; rank != size; ++rank)
+        endpoints_.emplace_back(new Endpoint(*this, rank));
+}
+
+LoopbackNetwork::~LoopbackNetwork() = default;
+
+Transport& LoopbackNetwork::endpoint(unsigned rank)
+{
+    return *endpoints_.at(rank);
+}
+
+void LoopbackNetwork::deliver(unsigned from, unsigned to, Message message)
+{
+    if (to >= size())
+        throw std::runtime_error("LoopbackNetwork: no such worker");
+
+    {
+        std::lock_guard<std::mutex> lock {mutex_};
+        channels_[size_t(from) * size() + to].messages.push_back(std::move(message));
+    }
+    delivered_.notify_all();
+}
+
+Message LoopbackNetwork::take(unsigned from, unsigned to)
+{
+    if (from >= size())
+        throw std::runtime_error("LoopbackNetwork: no such worker");
+
+    std::unique_lock<std::mutex> lock {mutex_};
+    auto& messages = channels_[size_t(from) * size() + to].messages;
+    delivered_.wait(lock, [&messages] { return !messages.empty(); });
+
+    Message message = std::move(messages.front());
+    messages.pop_front();
+    return message;
+}
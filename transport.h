@@ -0,0 +1,81 @@
+/******************************************************
+ *
+ *  Message passing between the workers of a fold that
+ *  is split across several machines.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_TRANSPORT_H
+#define EULER67_TRANSPORT_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+using Message = std::vector<unsigned char>;
+
+/* A Transport is one worker's connection to the others. Workers are
+ * numbered from 0 (their "rank"), and a message sent from one worker to
+ * another is received in the order it was sent.
+ *
+ * The banded fold (see banded_fold.h) only ever talks to a Transport, so a
+ * network transport can be dropped in without touching the fold. Either
+ * call may throw std::runtime_error if the connection fails.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual unsigned rank() const = 0;
+    virtual unsigned size() const = 0;
+
+    virtual void send(unsigned to, Message message) = 0;
+
+    /* Block until the next message from worker `from` arrives.
+     */
+    virtual Message receive(unsigned from) = 0;
+};
+
+
+/* A LoopbackNetwork connects `size` workers in the same process, such as
+ * one thread per worker. It is a stand-in for a real network, for testing
+ * and for running the distributed fold on one machine.
+ */
+class LoopbackNetwork {
+public:
+    explicit LoopbackNetwork(unsigned size);
+    ~LoopbackNetwork();
+
+    LoopbackNetwork(LoopbackNetwork const&) = delete;
+    LoopbackNetwork& operator=(LoopbackNetwork const&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(endpoints_.size()); }
+
+    /* The Transport of worker `rank`. It lives as long as the network.
+     */
+    Transport& endpoint(unsigned rank);
+
+private:
+    class Endpoint;
+
+    // One queue per (sender, receiver) pair, at `from * size + to`.
+    struct Channel {
+        std::deque<Message> messages;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable delivered_;
+    std::vector<Channel> channels_;
+    std::vector<std::unique_ptr<Endpoint>> endpoints_;
+
+    void deliver(unsigned from, unsigned to, Message message);
+    Message take(unsigned from, unsigned to);
+};
+
+#endif // EULER67_TRANSPORT_H
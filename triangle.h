@@ -0,0 +1,696 @@
+/******************************************************
+ *
+ *  The Triangle datatype and the bottom-up fold used to
+ *  solve Project Euler Problem 67.
+ *
+ *    -  see https://projecteuler.net/problem=67
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_TRIANGLE_H
+#define EULER67_TRIANGLE_H
+
+#include <vector>
+#include <algorithm>      // std::max
+#include <iterator>       // std::next
+
+#include <climits>        // INT_MAX
+#include <cstring>        // std::memchr
+#include <istream>
+#include <sstream>
+#include <string>
+
+#include <functional>     // std::function
+
+#include <stdexcept>      // std::argument_error
+
+#include "huge_pages.h"
+
+
+
+/* A RowView is a read-only view of one row of a Triangle: a pointer to its
+ * first value and its length. It is as cheap to copy as a pointer, and
+ * says nothing about how the rows are stored, so code written against it
+ * works for any storage that keeps each row contiguous.
+ *
+ * A RowView is only valid until its Triangle is modified or destroyed.
+ */
+class RowView {
+    int const* data_;
+    size_t size_;
+
+public:
+    RowView(int const* data, size_t size)
+        : data_(data), size_(size)
+    {}
+
+    int const* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    int const* begin() const { return data_; }
+    int const* end() const { return data_ + size_; }
+
+    int operator[](size_t n) const { return data_[n]; }
+    int front() const { return data_[0]; }
+    int back() const { return data_[size_ - 1]; }
+};
+
+/* The values of a triangle stored row after row, as in the file format,
+ * put row `r` at this offset.
+ */
+constexpr size_t triangle_row_offset(size_t r)
+{
+    return r * (r + 1) / 2;
+}
+
+/* The rows of a triangle whose values are stored row after row, from the
+ * top, as a range of RowViews:
+ *
+ *     for (RowView row: triangle.rows())
+ *         ...
+ */
+class RowRange {
+    int const* values_;
+    size_t height_;
+
+public:
+    class iterator {
+        int const* values_;
+        size_t r_;
+
+    public:
+        iterator(int const* values, size_t r)
+            : values_(values), r_(r)
+        {}
+
+        RowView operator*() const
+        {
+            return RowView(values_ + triangle_row_offset(r_), r_ + 1);
+        }
+
+        iterator& operator++() { ++r_; return *this; }
+        iterator& operator--() { --r_; return *this; }
+
+        bool operator==(iterator const& other) const { return r_ == other.r_; }
+        bool operator!=(iterator const& other) const { return r_ != other.r_; }
+    };
+
+    RowRange(int const* values, size_t height)
+        : values_(values), height_(height)
+    {}
+
+    size_t size() const { return height_; }
+
+    RowView operator[](size_t r) const
+    {
+        return RowView(values_ + triangle_row_offset(r), r + 1);
+    }
+
+    RowView front() const { return (*this)[0]; }
+    RowView back() const { return (*this)[height_ - 1]; }
+
+    iterator begin() const { return iterator(values_, 0); }
+    iterator end() const { return iterator(values_, height_); }
+};
+
+
+/* A Triangle consists of multiple rows of ints where the first row
+ * contains one element and each other row has precisely one more element
+ * than the row preceeding it. An example Triangle can be depicted like this:
+ *
+ *     3
+ *    7 4     (taken from the description of Project Euler Problem 67)
+ *   2 4 6
+ *  8 5 9 3
+ *
+ * It is important that the row-length property is not violated because each
+ * number in the Triangle is considered adjacent to the two below it.
+ * Ensuring correctness is much simpler if we can guarantee this property
+ * statically.
+ *
+ * This class only allows you to construct Triangles that satisfy this
+ * property. You can create Triangles by:
+ *   - Constructing an empty Triangle with the default constructor, or with
+ *     a PageSize to choose how its values are stored
+ *   - Copying, moving, or assigning (from an existing correct Triangle)
+ *   - Adding rows to a Triangle one at a time. If the user tries to add
+ *     a row with the wrong number of elements, the Triangle is not modified
+ *     and std::invalid_argument exception is thrown.
+ */
+class Triangle {
+public:
+    /* The type of a row passed to `append_row`.
+     */
+    using Row = std::vector<int>;
+
+private:
+    /*  Class Invariant:    values_.size() == triangle_row_offset(height_)
+     *
+     *  The rows are stored one after another in a single vector, so row `r`
+     *  starts at `triangle_row_offset(r)` and has `r + 1` values. This is
+     *  the same layout as the binary file format, and a fold walks through
+     *  memory in one direction instead of chasing a pointer per row.
+     */
+
+    std::vector<int, HugePageAllocator<int>> values_;
+    size_t height_ = 0;
+
+public:
+    Triangle() = default;
+
+    /* An empty Triangle whose values will be stored in pages of the given
+     * size (see huge_pages.h). Huge pages make a fold of a very large
+     * triangle take far fewer TLB misses.
+     */
+    explicit Triangle(PageSize pages)
+        : values_(HugePageAllocator<int>(pages))
+    {}
+
+    /* A copy of `other` stored in pages of the given size.
+     */
+    Triangle(Triangle const& other, PageSize pages)
+        : values_(other.values_.begin(), other.values_.end(),
+                  HugePageAllocator<int>(pages)),
+          height_(other.height_)
+    {}
+
+    Triangle(Triangle const&) = default;
+    Triangle(Triangle&&) = default;
+    Triangle& operator=(Triangle const&) = default;
+    Triangle& operator=(Triangle&&) = default;
+
+    PageSize pages() const
+    {
+        return values_.get_allocator().pages();
+    }
+
+    /* Access the rows of the `Triangle`. The views are read-only because
+     * the user cannot be permitted to change the length of the rows.
+     */
+    RowRange rows() const
+    {
+        return RowRange(values_.data(), height_);
+    }
+
+    /* The r'th row. Precondition: r < triangle.height()
+     */
+    RowView row(size_t r) const
+    {
+        return RowView(values_.data() + triangle_row_offset(r), r + 1);
+    }
+
+    /* All the values, row after row from the top.
+     */
+    int const* data() const
+    {
+        return values_.data();
+    }
+
+    /* `Triangle::at(r,n)` returns the n'th value of the r'th row.
+     *
+     *  The non-const version of this function is the only way for the user
+     *  to modify the contents of the Triangle. If the user does not satisfy
+     *  the preconditions the result is undefined.
+     *
+     *  Preconditions:
+     *
+     *      r < triangle.height()
+     *      n <= r + 1
+     */
+    int  at(size_t row, size_t n) const { return values_[triangle_row_offset(row) + n]; }
+    int& at(size_t row, size_t n)       { return values_[triangle_row_offset(row) + n]; }
+
+
+    /* The height of a Triangle is the number of rows.
+     */
+    size_t height() const
+    {
+        return height_;
+    }
+
+    /* The width is the size of the bottom-most row. This is equal to the
+     * height, but is defined seperately to improve clarity.
+     */
+    size_t width() const
+    {
+        return height();
+    }
+
+    /* Add a row to the tree. It must have a size equal to the new height of
+     * the tree (the current height plus one).
+     */
+    void append_row(Row&& row)
+    {
+        if (row.size() != this->height() + 1)
+        {
+            throw std::invalid_argument(
+                "Triangle::append_row requires that input row has a size equal"
+                " to the height of the triangle plus one");
+        }
+
+        values_.insert(values_.end(), row.begin(), row.end());
+        ++height_;
+    }
+
+    /*  Note: we depend on the default constructors here and let
+     *  std::vector do all the work of memory management.
+     *
+     *  This class is solely responsible for maintaining the
+     *  row-length invariant.
+     */
+};
+
+
+/* Ask for the cache line holding `*p` to be loaded, without waiting for
+ * it. This is only a hint: it never faults, and does nothing on compilers
+ * without the builtin.
+ */
+inline void prefetch_values(int const* p)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+/* How many rows ahead of the row being folded `fold_triangle` prefetches
+ * by default. The rows of a Triangle are adjacent, and the fold reads them
+ * in one direction, which the hardware prefetcher follows well enough that
+ * prefetching by hand measured no faster (see the fold_triangle_prefetch_*
+ * bench phases), so it is off unless asked for. It may pay on machines
+ * whose prefetcher stops at every page boundary.
+ */
+size_t const default_prefetch_rows = 0;
+
+/* fold_row<T>(accum, values, size, combine_t)
+ *     - performs one step of `fold_triangle`: folds the row `values`
+ *       (of length `size`) into `accum`, which holds the results of the
+ *       row below it and so must contain at least `size + 1` values.
+ *
+ * This is separate from `fold_triangle` so that traversals which do not
+ * hold a whole Triangle in memory (such as the out-of-core fold, which
+ * reads one row at a time from a file) share exactly the same step.
+ */
+template <typename T>
+void fold_row(std::vector<T>& accum, int const* values, size_t size,
+              std::function<T(int,T,T)> const& combine_t)
+{
+    // Start at the beginning of the list of T's
+    auto accum_iter = accum.begin();
+
+    /* For each value `n` in the row,
+     * apply the user-provided function `combine_t` to `n` and
+     * the two below-and-adjacent T's that were previously computed.
+     *
+     * The bidirectional iterator `accum_iter` is used to read the
+     * value from the accumulator and then overwrite it with a new value.
+     */
+    for (size_t i = 0; i != size; ++i)
+    {
+        int value = values[i];
+        *accum_iter =
+            combine_t(value, *accum_iter, *std::next(accum_iter));
+        ++accum_iter;
+    }
+
+    /* Note:
+     *   At this point we could erase the remaining values which were not
+     *   overwritten like this:
+     *   
+     *       accum.erase(accum_iter, accum.end());
+     *
+     *   However, there is no harm in leaving them there so long as we
+     *   don't access them again.
+     */
+}
+
+/* fold_row<T>(accum, values, size, combine_t, ahead)
+ *     - the same step, also prefetching the values of `ahead`, a row that
+ *       will be folded later, one cache line for every cache line of
+ *       `values`. Rows only get shorter going up, so the whole of `ahead`
+ *       is asked for by the time this row is done.
+ */
+template <typename T>
+void fold_row(std::vector<T>& accum, int const* values, size_t size,
+              std::function<T(int,T,T)> const& combine_t,
+              RowView ahead)
+{
+    size_t const line = 64 / sizeof(int);
+
+    // One cache line of the row at a time, so that the inner loop is the
+    // same as in the version above.
+    auto accum_iter = accum.begin();
+    for (size_t i = 0; i < size; i += line)
+    {
+        if (i < ahead.size())
+            prefetch_values(ahead.data() + i);
+
+        size_t const end = std::min(size, i + line);
+        for (size_t j = i; j != end; ++j)
+        {
+            *accum_iter =
+                combine_t(values[j], *accum_iter, *std::next(accum_iter));
+            ++accum_iter;
+        }
+    }
+
+    // A row that does not start on a cache line ends in one more.
+    if (ahead.size() != 0)
+        prefetch_values(ahead.data() + ahead.size() - 1);
+}
+
+
+/* A FoldWorkspace holds the accumulator of `fold_triangle`, so that a
+ * caller which folds many triangles can allocate it once and reuse it.
+ * The storage only ever grows: after the first fold of a given width,
+ * folding triangles of that width or smaller never touches the allocator.
+ *
+ * A workspace must not be used by two folds at the same time, including a
+ * fold whose `make_t` or `combine_t` itself folds with the same workspace.
+ */
+template <typename T>
+class FoldWorkspace {
+    std::vector<T> accum_;
+
+public:
+    /* Empty the accumulator and make room for `width` values.
+     */
+    std::vector<T>& accum(size_t width)
+    {
+        accum_.clear();
+        accum_.reserve(width);
+        return accum_;
+    }
+
+    size_t capacity() const
+    {
+        return accum_.capacity();
+    }
+};
+
+/* thread_workspace<T>() returns this thread's FoldWorkspace for T.
+ *
+ * There is one workspace per thread and per type, so concurrent solves on
+ * different threads never share one, and repeated solves on one thread
+ * reuse the same storage. It is released when the thread exits.
+ */
+template <typename T>
+FoldWorkspace<T>& thread_workspace()
+{
+    static thread_local FoldWorkspace<T> workspace;
+    return workspace;
+}
+
+
+/* fold_triangle<T>(tri, make_t, combine_t, workspace, prefetch_rows)
+ *     - the same as the version below, but computes each row in the
+ *       accumulator of `workspace` instead of allocating a new one.
+ *     - while folding row `r`, prefetches row `r - prefetch_rows`. 0 turns
+ *       the prefetching off.
+ */
+template <typename T>
+T fold_triangle(Triangle const& triangle,
+       std::function<T(int)> const& make_t,
+       std::function<T(int,T,T)> const& combine_t,
+       FoldWorkspace<T>& workspace,
+       size_t prefetch_rows = default_prefetch_rows)
+{
+    if (triangle.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle expects a non-empty triangle");
+    }
+
+    /* We're going to use this vector to compute the values of each row.
+     * With each row iteration, the values of `accum` will be overwritten.
+     *
+     * This is a vector instead of an array because in general we won't
+     * know the size of the Triangle until runtime.
+     */
+    std::vector<T>& accum = workspace.accum(triangle.width());
+
+    // First we fill `accum` with the results of mapping the function
+    // `make_t` over the values of the bottom row.
+    for (int value: triangle.row(triangle.height() - 1))
+    {
+        accum.emplace_back(make_t(value));
+    }
+
+    // Traverse all the rows from the bottom up. Once the rows to prefetch
+    // run out above the top, the rest are folded without it.
+    size_t r = triangle.height() - 1;
+    for (; prefetch_rows != 0 && r > prefetch_rows; )
+    {
+        --r;
+        RowView const row = triangle.row(r);
+        fold_row<T>(accum, row.data(), row.size(), combine_t,
+                    triangle.row(r - prefetch_rows));
+    }
+    while (r-- != 0)
+    {
+        RowView const row = triangle.row(r);
+        fold_row<T>(accum, row.data(), row.size(), combine_t);
+    }
+
+    // All the rows have been processed, and the final reduction is at the
+    // front of `accum`.
+    return accum.front();
+}
+
+/* fold_triangle<T>(tri, make_t, combine_t)
+ *     - reduces the entire triangle to a single value of type T
+ *       by traversing each row from the bottom up
+ *     - uses `make_t` to produce a T from every value in the bottom row
+ *     - uses `combine_t` to aggregate each number with the two T's below it.
+ *     - does not modify the original triangle
+ *
+ * First a `T` is produced from every `int` in the bottom row of the triangle 
+ * using the function `make_t`.
+ *
+ *     3
+ *    7 4       ==>    ts = { make_t(2), make_t(4), make_t(6) }
+ *   2 4 6 <-
+ *
+ *
+ * Then, `combine_t` is used to combine each `int` in the next-highest row
+ * with the two `T`s that were just produced in the corresponding positions
+ * in the row below it. 
+ *
+ *     3
+ *    7 4  <-   ==>    ts' = { combine_t(7, ts[0], ts[1]),
+ *   2 4 6                     combine_t(4, ts[1], ts[2])
+ *
+ *
+ * This is applied iteratively to each row until only the top row remains,
+ * with a single value of `T`.
+ *
+ *     3   <-
+ *    7 4       ==>    ts'' = { combine_t(3, ts'[0], ts'[1]) }
+ *   2 4 6                      
+ *
+ * This version allocates a fresh accumulator for every call, so it is safe
+ * to call from anywhere, including from within `make_t` or `combine_t`.
+ */
+template <typename T>
+T fold_triangle(Triangle const& triangle,
+       std::function<T(int)> make_t,
+       std::function<T(int,T,T)> combine_t)
+{
+    FoldWorkspace<T> workspace;
+    return fold_triangle<T>(triangle, make_t, combine_t, workspace);
+}
+
+/* The combining rules of the two problems below are kept as named functions
+ * so that other traversals (such as the per-cell path tables built by the
+ * solver server) apply exactly the same rule as `max_path` and
+ * `max_odd_even_path`. They are constexpr so that they can also be used to
+ * solve triangles at compile time (see fixed_triangle.h).
+ *
+ * `max_path_combine` adds a number to the greater of the two results below.
+ */
+constexpr int max_path_combine(int i, int left, int right)
+{
+    return i + std::max(left, right);
+}
+
+/* `odd_even_path_combine` only allows a left step onto an odd result and
+ * a right step onto an even result. A forbidden step contributes nothing.
+ */
+constexpr int odd_even_path_combine(int i, int left, int right)
+{
+    return i +
+        std::max(left % 2 == 0 ? 0 : left,
+                 right % 2 == 0 ? right : 0);
+}
+
+/* The same rules as function objects. Unlike function pointers, these
+ * carry the rule in their type, so a fold templated on them can inline the
+ * rule (and evaluate it in a constant expression).
+ */
+struct LeafValue {
+    constexpr int operator()(int i) const { return i; }
+};
+
+struct MaxPathCombine {
+    constexpr int operator()(int i, int left, int right) const
+    {
+        return max_path_combine(i, left, right);
+    }
+};
+
+struct OddEvenPathCombine {
+    constexpr int operator()(int i, int left, int right) const
+    {
+        return odd_even_path_combine(i, left, right);
+    }
+};
+
+/* This function uses `fold_triangle<int>` to compute the solution to
+ * Project Euler Number 67.
+ *
+ * It works by starting at the bottom row and working upwards, eliminating
+ * the lesser of adjacent paths until it reaching the top.
+ *
+ * Note that by using the `fold_triangle` to handle the traversal, this
+ * function has been distilled down to its basic components.
+ */
+inline int max_path(Triangle const& triangle)
+{
+    // For the bottom row, the result of each number is simply that number.
+    auto leaf = [](int i) -> int { return i; };
+
+    // For every other row, the result of each number is that number plus the
+    // greater of the two results immediately under it.
+    //
+    // The accumulator comes from this thread's workspace, so solving many
+    // triangles in a row does not allocate.
+    return fold_triangle<int>(triangle, leaf, max_path_combine,
+                              thread_workspace<int>());
+}
+
+/* For fun, I added more rules to the problem.
+ * As before, we must find the path of maximum value. However, we add the rule
+ * that the path may only turn left onto an odd number, and may only go right
+ * onto an even number.
+ *
+ * If the path reaches a point where it cannot continue, it has reached
+ * the maximum value of that path.
+ *
+ * The change is relatively small, because fold_triangle<T> does all the
+ * work in traversing the triangle and combining adjacent values.
+ */
+inline int max_odd_even_path(Triangle const& triangle)
+{
+    auto leaf = [](int i) -> int { return i; };
+
+    return fold_triangle<int>(triangle, leaf, odd_even_path_combine,
+                              thread_workspace<int>());
+}
+
+
+// Parse a file containing a Triangle in the format provided by
+// Project Euler Problem 67. Any input stream will do, so triangles can be
+// read from files and from in-memory buffers alike.
+inline Triangle parse_triangle(std::istream& stream)
+{
+    Triangle triangle;
+    std::string row_string;
+
+    size_t expected_row_size = 0;
+
+    // Each line corresponds to a row
+    while (std::getline(stream, row_string))
+    {
+        ++expected_row_size;
+
+        // Triangle::Row is an alias for std::vector<int>
+        Triangle::Row row;
+        row.reserve(expected_row_size);
+
+        int value;
+        std::istringstream row_stream {row_string};
+
+        // Each row contains values seperated by whitespace
+        while (row_stream >> value)
+        {
+            row.push_back(value);
+        }
+
+        // C++11 helps us avoid copying the entire row
+        triangle.append_row(std::move(row));
+    }
+
+    // Hopefully return value optimization will kick in here and avoid
+    // copying the entire Triangle.
+    return triangle;
+}
+
+
+/* Parse a Triangle from text that is already in memory, such as a file
+ * buffer handed over by the asynchronous loader. It accepts the same format
+ * as the stream version above and gives the same result, but it tokenizes
+ * the buffer directly instead of going through a stringstream per row.
+ */
+inline Triangle parse_triangle(char const* data, size_t size)
+{
+    Triangle triangle;
+
+    auto is_space = [](char c) -> bool {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    };
+
+    char const* p = data;
+    char const* const end = data + size;
+
+    // Each line corresponds to a row
+    while (p != end)
+    {
+        char const* eol = static_cast<char const*>(
+            std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (!eol)
+            eol = end;
+
+        Triangle::Row row;
+        row.reserve(triangle.height() + 1);
+
+        // Like `row_stream >> value`, stop the row at anything that is not
+        // an int (including one too large to fit).
+        for (;;)
+        {
+            while (p != eol && is_space(*p))
+                ++p;
+            if (p == eol)
+                break;
+
+            bool const negative = *p == '-';
+            if (*p == '-' || *p == '+')
+                ++p;
+
+            char const* digits = p;
+            long long value = 0;
+            long long const limit = INT_MAX + (negative ? 1ll : 0ll);
+            bool too_large = false;
+            for (; p != eol && *p >= '0' && *p <= '9'; ++p)
+            {
+                value = value * 10 + (*p - '0');
+                too_large = too_large || value > limit;
+                if (too_large)
+                    value = 0;
+            }
+
+            if (p == digits || too_large)
+                break;
+            row.push_back(static_cast<int>(negative ? -value : value));
+        }
+
+        triangle.append_row(std::move(row));
+        p = eol == end ? end : eol + 1;
+    }
+
+    return triangle;
+}
+
+#endif // EULER67_TRIANGLE_H
@@ -0,0 +1,389 @@
+/******************************************************
+ *
+ *  A binary file format for Triangles, and a fold that
+ *  works on triangle files too large to fit in memory.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE       // O_DIRECT
+#endif
+
+#include "triangle_file.h"
+
+#include <algorithm>      // std::max
+#include <cerrno>
+#include <cstdlib>        // posix_memalign
+#include <cstring>
+#include <new>            // std::bad_alloc
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+char const binary_magic[8] = { 'E', 'U', 'L', 'E', 'R', '6', '7', 'B' };
+std::uint32_t const binary_version = 1;
+
+// O_DIRECT needs buffers, offsets and lengths aligned to the logical block
+// size of the device. 4KiB is a multiple of it on every device we care about.
+size_t const io_alignment = 4096;
+
+
+void put_u32(unsigned char* p, std::uint32_t v)
+{
+    for (int i = 0; i != 4; ++i)
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+void put_u64(unsigned char* p, std::uint64_t v)
+{
+    for (int i = 0; i != 8; ++i)
+        p[i] = static_cast<unsigned char>(v >> (8 * i));
+}
+
+std::uint32_t get_u32(unsigned char const* p)
+{
+    std::uint32_t v = 0;
+    for (int i = 0; i != 4; ++i)
+        v |= std::uint32_t(p[i]) << (8 * i);
+    return v;
+}
+
+std::uint64_t get_u64(unsigned char const* p)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i != 8; ++i)
+        v |= std::uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+/* The identity of an open file for `ReverseRowReader::identity`: an
+ * FNV-1a hash of where it is and of what changes when it is rewritten.
+ */
+std::uint64_t file_identity(int fd, std::string const& path)
+{
+    struct stat status;
+    if (::fstat(fd, &status) != 0)
+        throw std::runtime_error("fstat " + path + ": " + std::strerror(errno));
+
+    std::uint64_t const fields[] = {
+        static_cast<std::uint64_t>(status.st_dev),
+        static_cast<std::uint64_t>(status.st_ino),
+        static_cast<std::uint64_t>(status.st_size),
+        static_cast<std::uint64_t>(status.st_mtim.tv_sec),
+        static_cast<std::uint64_t>(status.st_mtim.tv_nsec),
+    };
+
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    for (std::uint64_t field: fields)
+    {
+        for (int i = 0; i != 8; ++i)
+        {
+            hash ^= (field >> (8 * i)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+void encode_header(unsigned char (&header)[binary_header_size],
+                   std::uint64_t height)
+{
+    std::memset(header, 0, sizeof header);
+    std::memcpy(header, binary_magic, sizeof binary_magic);
+    put_u32(header + 8, binary_version);
+    put_u64(header + 16, height);
+}
+
+std::uint64_t decode_header(unsigned char const* header)
+{
+    if (std::memcmp(header, binary_magic, sizeof binary_magic) != 0)
+        throw std::runtime_error("not a binary triangle file");
+    if (get_u32(header + 8) != binary_version)
+        throw std::runtime_error("unsupported binary triangle version");
+    return get_u64(header + 16);
+}
+
+/* Values are stored little-endian. On a little-endian host (every machine
+ * we run on) that is a plain copy; otherwise each value is assembled.
+ */
+void decode_values(unsigned char const* bytes, size_t count, int* values)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    std::memcpy(values, bytes, count * sizeof(std::int32_t));
+#else
+    for (size_t i = 0; i != count; ++i)
+        values[i] = static_cast<std::int32_t>(get_u32(bytes + 4 * i));
+#endif
+}
+
+void write_row(std::ostream& out, int const* values, size_t count)
+{
+    std::vector<unsigned char> bytes(count * 4);
+    for (size_t i = 0; i != count; ++i)
+        put_u32(bytes.data() + 4 * i, static_cast<std::uint32_t>(values[i]));
+    out.write(reinterpret_cast<char const*>(bytes.data()), bytes.size());
+}
+
+std::uint64_t align_down(std::uint64_t offset)
+{
+    return offset / io_alignment * io_alignment;
+}
+
+std::uint64_t align_up(std::uint64_t offset)
+{
+    return align_down(offset + io_alignment - 1);
+}
+
+} // namespace
+
+
+std::uint64_t convert_text_to_binary(std::istream& text, std::ostream& out)
+{
+    unsigned char header[binary_header_size];
+    encode_header(header, 0);
+    out.write(reinterpret_cast<char const*>(header), sizeof header);
+
+    std::uint64_t height = 0;
+    std::string row_string;
+    std::vector<int> row;
+
+    while (std::getline(text, row_string))
+    {
+        ++height;
+
+        row.clear();
+        int value;
+        std::istringstream row_stream {row_string};
+        while (row_stream >> value)
+            row.push_back(value);
+
+        if (row.size() != height)
+        {
+            throw std::invalid_argument(
+                "convert_text_to_binary requires that row n has n values");
+        }
+        write_row(out, row.data(), row.size());
+    }
+
+    // Now that we know the height, go back and fill it in.
+    encode_header(header, height);
+    out.seekp(0);
+    out.write(reinterpret_cast<char const*>(header), sizeof header);
+    out.flush();
+    if (!out)
+        throw std::runtime_error("failed to write binary triangle");
+
+    return height;
+}
+
+void write_binary_triangle(std::ostream& out, Triangle const& triangle)
+{
+    unsigned char header[binary_header_size];
+    encode_header(header, triangle.height());
+    out.write(reinterpret_cast<char const*>(header), sizeof header);
+
+    for (RowView row: triangle.rows())
+        write_row(out, row.data(), row.size());
+}
+
+Triangle read_binary_triangle(std::istream& in)
+{
+    unsigned char header[binary_header_size];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof header))
+        throw std::runtime_error("truncated binary triangle header");
+
+    std::uint64_t const height = decode_header(header);
+
+    Triangle triangle;
+    std::vector<unsigned char> bytes;
+    for (std::uint64_t r = 0; r != height; ++r)
+    {
+        bytes.resize((r + 1) * 4);
+        if (!in.read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+            throw std::runtime_error("truncated binary triangle");
+
+        Triangle::Row row(r + 1);
+        decode_values(bytes.data(), row.size(), row.data());
+        triangle.append_row(std::move(row));
+    }
+    return triangle;
+}
+
+void encode_binary_triangle(Triangle const& triangle, unsigned char* out)
+{
+    unsigned char header[binary_header_size];
+    encode_header(header, triangle.height());
+    std::memcpy(out, header, sizeof header);
+
+    for (size_t r = 0; r != triangle.height(); ++r)
+    {
+        unsigned char* p = out + binary_row_offset(r);
+        for (int value: triangle.row(r))
+        {
+            put_u32(p, static_cast<std::uint32_t>(value));
+            p += 4;
+        }
+    }
+}
+
+Triangle decode_binary_triangle(unsigned char const* bytes, std::uint64_t size)
+{
+    if (size < binary_header_size)
+        throw std::runtime_error("truncated binary triangle header");
+
+    std::uint64_t const height = decode_header(bytes);
+    if (height > size || binary_row_offset(height) > size)
+        throw std::runtime_error("truncated binary triangle");
+
+    Triangle triangle;
+    for (std::uint64_t r = 0; r != height; ++r)
+    {
+        Triangle::Row row(r + 1);
+        decode_values(bytes + binary_row_offset(r), row.size(), row.data());
+        triangle.append_row(std::move(row));
+    }
+    return triangle;
+}
+
+std::uint64_t decode_binary_header(unsigned char const* header)
+{
+    return decode_header(header);
+}
+
+
+ReverseRowReader::ReverseRowReader(std::string const& path, bool direct_io,
+                                   size_t block_size)
+    : fd_(-1), direct_io_(direct_io), height_(0), identity_(0), next_row_(0),
+      block_size_(align_up(std::max<size_t>(block_size, io_alignment))),
+      block_(nullptr), block_start_(0), block_end_(0)
+{
+    if (direct_io_)
+    {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+
+        // tmpfs and some other file systems reject O_DIRECT.
+        if (fd_ < 0 && errno == EINVAL)
+            direct_io_ = false;
+    }
+    if (fd_ < 0)
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("cannot open " + path + ": "
+                                 + std::strerror(errno));
+    }
+
+    void* buffer = nullptr;
+    if (::posix_memalign(&buffer, io_alignment, block_size_) != 0)
+    {
+        ::close(fd_);
+        throw std::bad_alloc();
+    }
+    block_ = static_cast<unsigned char*>(buffer);
+
+    // The header is read through the block buffer too, since O_DIRECT
+    // cannot read into an unaligned buffer.
+    try {
+        fill_block_ending_at(io_alignment);
+        if (block_end_ < binary_header_size)
+            throw std::runtime_error(path + " is too short to be a triangle");
+        height_ = decode_header(block_);
+        identity_ = file_identity(fd_, path);
+    }
+    catch (...) {
+        std::free(block_);
+        ::close(fd_);
+        throw;
+    }
+    next_row_ = height_;
+}
+
+ReverseRowReader::~ReverseRowReader()
+{
+    std::free(block_);
+    ::close(fd_);
+}
+
+/* Fill the block so that it covers the aligned range that ends at `end`
+ * (rounded up to the alignment) and extends backwards by one block.
+ */
+void ReverseRowReader::fill_block_ending_at(std::uint64_t end)
+{
+    std::uint64_t const stop = align_up(end);
+    std::uint64_t const start = stop > block_size_ ? stop - block_size_ : 0;
+
+    size_t done = 0;
+    size_t const wanted = stop - start;
+    while (done != wanted)
+    {
+        ssize_t got = ::pread(fd_, block_ + done, wanted - done, start + done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0)
+        {
+            throw std::runtime_error(std::string("pread: ")
+                                     + std::strerror(errno));
+        }
+        if (got == 0)
+            break;    // end of file
+        done += static_cast<size_t>(got);
+
+        // O_DIRECT reads must stay aligned, so stop on a short read at the
+        // end of the file rather than retrying from an unaligned offset.
+        if (direct_io_ && done % io_alignment != 0)
+            break;
+    }
+
+    block_start_ = start;
+    block_end_ = start + done;
+}
+
+void ReverseRowReader::skip_to(std::uint64_t row)
+{
+    if (row > height_)
+        throw std::invalid_argument("ReverseRowReader::skip_to: no such row");
+    next_row_ = row;
+}
+
+bool ReverseRowReader::previous_row(std::vector<int>& row)
+{
+    if (next_row_ == 0)
+        return false;
+
+    std::uint64_t const r = --next_row_;
+    std::uint64_t const first = binary_row_offset(r);
+    std::uint64_t const last = binary_row_offset(r + 1);
+
+    row.resize(r + 1);
+
+    // Copy the row from its end towards its start, refilling the block
+    // whenever we run off its beginning. Rows wider than a block simply
+    // take several refills.
+    std::uint64_t position = last;
+    while (position != first)
+    {
+        if (position <= block_start_ || position > block_end_)
+        {
+            fill_block_ending_at(position);
+            if (position > block_end_)
+                throw std::runtime_error("truncated binary triangle");
+        }
+
+        std::uint64_t const from = std::max(first, block_start_);
+        size_t const index = (from - first) / sizeof(std::int32_t);
+        decode_values(block_ + (from - block_start_),
+                      (position - from) / sizeof(std::int32_t),
+                      row.data() + index);
+        position = from;
+    }
+    return true;
+}
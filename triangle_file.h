@@ -0,0 +1,276 @@
+/******************************************************
+ *
+ *  A binary file format for Triangles, and a fold that
+ *  works on triangle files too large to fit in memory.
+ *
+ *  Written by Craig Roche
+ *
+*******************************************************
+*/
+
+#ifndef EULER67_TRIANGLE_FILE_H
+#define EULER67_TRIANGLE_FILE_H
+
+#include "triangle.h"
+#include "checkpoint.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>         // std::remove
+#include <cstring>        // std::memcpy
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/* The binary triangle format is a fixed header followed by every value of
+ * the triangle, row by row from the top, as little-endian 32-bit integers:
+ *
+ *     offset  size  contents
+ *          0     8  magic "EULER67B"
+ *          8     4  format version (1)
+ *         12     4  reserved (0)
+ *         16     8  height (number of rows)
+ *         24     8  reserved (0)
+ *         32   ...  values
+ *
+ * Because every row r has exactly r + 1 values, row r starts at
+ * `binary_row_offset(r)` and no index is needed to find it.
+ */
+std::uint64_t const binary_header_size = 32;
+
+inline std::uint64_t binary_row_offset(std::uint64_t row)
+{
+    return binary_header_size + row * (row + 1) / 2 * sizeof(std::int32_t);
+}
+
+/* Convert a triangle in the text format of `parse_triangle` to the binary
+ * format, one row at a time. `out` must be seekable because the height is
+ * only known at the end. Returns the height. Like `Triangle::append_row`,
+ * throws std::invalid_argument if a row has the wrong number of values.
+ */
+std::uint64_t convert_text_to_binary(std::istream& text, std::ostream& out);
+
+void write_binary_triangle(std::ostream& out, Triangle const& triangle);
+Triangle read_binary_triangle(std::istream& in);
+
+/* The same format held in memory, such as in a shared memory segment.
+ * `out` must have room for `binary_row_offset(triangle.height())` bytes.
+ * Decoding throws std::runtime_error if `size` bytes do not hold a whole
+ * binary triangle.
+ */
+void encode_binary_triangle(Triangle const& triangle, unsigned char* out);
+Triangle decode_binary_triangle(unsigned char const* bytes, std::uint64_t size);
+
+/* Check the `binary_header_size` bytes of a header and return the height.
+ * Throws std::runtime_error if they are not a supported header.
+ */
+std::uint64_t decode_binary_header(unsigned char const* header);
+
+
+/* Reads the rows of a binary triangle file from the bottom up, which is the
+ * order in which `fold_triangle` consumes them.
+ *
+ * The file is read with pread() in large blocks aligned to 4KiB, walking
+ * backwards through the file, so memory use is one block plus one row no
+ * matter how large the triangle is. With `direct_io` the file is opened
+ * with O_DIRECT to bypass the page cache; if the file system does not
+ * support that, ordinary buffered reads are used instead.
+ */
+class ReverseRowReader {
+public:
+    explicit ReverseRowReader(std::string const& path,
+                              bool direct_io = false,
+                              size_t block_size = 8 << 20);
+    ~ReverseRowReader();
+
+    ReverseRowReader(ReverseRowReader const&) = delete;
+    ReverseRowReader& operator=(ReverseRowReader const&) = delete;
+
+    std::uint64_t height() const { return height_; }
+
+    /* Identifies the file being read: a hash of its device, inode, size
+     * and modification time. Another file, or the same path after the file
+     * was rewritten, has a different identity. Checkpoints store it.
+     */
+    std::uint64_t identity() const { return identity_; }
+
+    /* Read the next row up into `row`. Returns false once the top row has
+     * been read. Throws std::runtime_error on I/O errors.
+     */
+    bool previous_row(std::vector<int>& row);
+
+    /* Continue from the middle of the triangle: the next call to
+     * `previous_row` reads row `row - 1`. Used to resume from a checkpoint.
+     */
+    void skip_to(std::uint64_t row);
+
+private:
+    int fd_;
+    bool direct_io_;
+    std::uint64_t height_;
+    std::uint64_t identity_;
+    std::uint64_t next_row_;
+
+    size_t block_size_;
+    unsigned char* block_;        // aligned buffer of block_size_ bytes
+    std::uint64_t block_start_;   // file offset of block_[0]
+    std::uint64_t block_end_;     // file offset just past the valid bytes
+
+    void fill_block_ending_at(std::uint64_t end);
+};
+
+
+/* Options for the out-of-core fold.
+ */
+struct OutOfCoreOptions {
+    bool direct_io = false;
+    size_t block_size = 8 << 20;
+
+    // When set, the fold saves its progress to this file about every
+    // `checkpoint_seconds`, resumes from it if it already exists, and
+    // removes it once the fold is complete.
+    std::string checkpoint_path;
+    double checkpoint_seconds = 60;
+};
+
+
+namespace checkpoint_detail {
+
+/* Checkpoints store the accumulator as raw bytes, which is only possible
+ * for trivially copyable types. These let the fold still be instantiated
+ * for any T, as long as it is not asked to checkpoint.
+ */
+template <typename T>
+void save(std::vector<T> const& accum, std::uint64_t row,
+          ReverseRowReader const& reader, CheckpointWriter& writer,
+          std::true_type)
+{
+    Checkpoint checkpoint;
+    checkpoint.value_size = sizeof(T);
+    checkpoint.height = reader.height();
+    checkpoint.row = row;
+    checkpoint.source = reader.identity();
+    checkpoint.accum.resize((row + 1) * sizeof(T));
+    std::memcpy(checkpoint.accum.data(), accum.data(), checkpoint.accum.size());
+    writer.submit(std::move(checkpoint));
+}
+
+template <typename T>
+void restore(Checkpoint const& checkpoint, std::vector<T>& accum, std::true_type)
+{
+    if (checkpoint.value_size != sizeof(T))
+        throw std::runtime_error("checkpoint was saved by a different fold");
+
+    accum.resize(checkpoint.row + 1);
+    std::memcpy(accum.data(), checkpoint.accum.data(), checkpoint.accum.size());
+}
+
+template <typename T>
+void save(std::vector<T> const&, std::uint64_t, ReverseRowReader const&,
+          CheckpointWriter&, std::false_type)
+{
+}
+
+template <typename T>
+void restore(Checkpoint const&, std::vector<T>&, std::false_type)
+{
+}
+
+} // namespace checkpoint_detail
+
+/* fold_triangle_file<T>(path, make_t, combine_t)
+ *     - computes the same result as `fold_triangle<T>` on the triangle
+ *       stored in the binary file at `path`
+ *     - never holds more than one row of the triangle in memory, so peak
+ *       memory is O(width) for the accumulator and the row, plus one block
+ *     - with `options.checkpoint_path`, can be interrupted and resumed
+ *       (T must then be trivially copyable)
+ *
+ * Checkpoints are written by a background thread. At each checkpoint the
+ * fold only copies the live part of its accumulator, so it never waits for
+ * the disk. If a checkpoint cannot be written, the fold throws at its next
+ * checkpoint; once the fold is complete, a failed write is ignored.
+ */
+template <typename T>
+T fold_triangle_file(std::string const& path,
+       std::function<T(int)> make_t,
+       std::function<T(int,T,T)> combine_t,
+       OutOfCoreOptions const& options = OutOfCoreOptions())
+{
+    using clock = std::chrono::steady_clock;
+    using can_checkpoint = std::is_trivially_copyable<T>;
+
+    bool const checkpointing = !options.checkpoint_path.empty();
+    if (checkpointing && !can_checkpoint::value) {
+        throw std::invalid_argument(
+            "fold_triangle_file can only checkpoint trivially copyable types");
+    }
+
+    ReverseRowReader reader {path, options.direct_io, options.block_size};
+
+    if (reader.height() == 0) {
+        throw std::invalid_argument(
+            "fold_triangle_file expects a non-empty triangle");
+    }
+
+    std::vector<int> row;
+    row.reserve(reader.height());
+
+    std::vector<T> accum;
+    accum.reserve(reader.height());
+
+    Checkpoint saved;
+    if (checkpointing && load_checkpoint(options.checkpoint_path, saved))
+    {
+        if (saved.height != reader.height() || saved.source != reader.identity()) {
+            throw std::runtime_error(
+                options.checkpoint_path + " is for a different triangle, or "
+                + path + " has changed since it was saved");
+        }
+        checkpoint_detail::restore(saved, accum, can_checkpoint());
+        reader.skip_to(saved.row);
+    }
+    else
+    {
+        reader.previous_row(row);
+        for (int value: row)
+        {
+            accum.emplace_back(make_t(value));
+        }
+    }
+
+    std::unique_ptr<CheckpointWriter> writer;
+    if (checkpointing)
+        writer.reset(new CheckpointWriter(options.checkpoint_path));
+
+    auto const interval = std::chrono::duration<double>(options.checkpoint_seconds);
+    auto last_checkpoint = clock::now();
+
+    while (reader.previous_row(row))
+    {
+        fold_row<T>(accum, row.data(), row.size(), combine_t);
+
+        if (writer && clock::now() - last_checkpoint >= interval)
+        {
+            checkpoint_detail::save(accum, row.size() - 1, reader,
+                                    *writer, can_checkpoint());
+            last_checkpoint = clock::now();
+        }
+    }
+
+    // The fold is complete, so the checkpoint is no longer needed. Wait for
+    // any write in flight first so that it cannot recreate the file.
+    if (writer)
+    {
+        writer->finish();
+        std::remove(options.checkpoint_path.c_str());
+    }
+
+    return accum.front();
+}
+
+#endif // EULER67_TRIANGLE_FILE_H